@@ -16,6 +16,7 @@ extern "C" {
 #include <vector>
 #include <string>
 #include <map>
+#include <algorithm>
 #include <unordered_map>
 #ifdef USE_PREFIX_TRIE
 #include <cedarpp.h>
@@ -360,6 +361,42 @@ void lookup (T* t, char* data, size_t size, int& n_, int& n) {
   }
 }
 
+// batched lookup; only cedar supports it
+template <typename T>
+inline void lookup_batch (T* t, char* data, size_t size) {}
+#ifdef USE_PREFIX_TRIE
+template <>
+inline void lookup_batch <cedar_t> (cedar_t* t, char* data, size_t size) {
+  std::vector <const char*> key;
+  std::vector <size_t>      len;
+  for (char* start (data), *end (data), *tail (data + size);
+       end != tail; start = ++end) {
+    end = find_sep (end);
+    key.push_back (start);
+    len.push_back (end - start);
+  }
+  std::vector <int> result (key.size ());
+  struct timeval st, et;
+  int n_ = 0;
+  ::gettimeofday (&st, NULL);
+  for (size_t i = 0; i < key.size (); ++i)
+    if (t->exactMatchSearch <int> (key[i], len[i]) >= 0) ++n_;
+  ::gettimeofday (&et, NULL);
+  double elapsed = (et.tv_sec - st.tv_sec) + (et.tv_usec - st.tv_usec) * 1e-6;
+  std::fprintf (stderr, "%-20s %.2f sec (%.2f nsec per key)\n",
+                "Time to search (1):", elapsed, elapsed * 1e9 / key.size ());
+  ::gettimeofday (&st, NULL);
+  t->exactMatchSearch (&key[0], &len[0], &result[0], key.size ());
+  ::gettimeofday (&et, NULL);
+  elapsed = (et.tv_sec - st.tv_sec) + (et.tv_usec - st.tv_usec) * 1e-6;
+  std::fprintf (stderr, "%-20s %.2f sec (%.2f nsec per key)\n",
+                "Time to search (n):", elapsed, elapsed * 1e9 / key.size ());
+  for (size_t i = 0; i < key.size (); ++i)
+    if (result[i] >= 0) --n_;
+  if (n_) std::fprintf (stderr, "batched lookup mismatched\n");
+}
+#endif
+
 template <typename T>
 void bench (const char* keys, const char* queries, const char* label) {
   size_t rss = get_process_size ();
@@ -399,10 +436,209 @@ void bench (const char* keys, const char* queries, const char* label) {
     std::fprintf (stderr, "%-20s %d\n", "Words:", n);
     std::fprintf (stderr, "%-20s %d\n", "Found:", n_);
     delete [] data;
+    // compare scalar and batched lookups on pre-split queries
+    read_data (queries, data);
+    lookup_batch (t, data, size);
+    delete [] data;
+  }
+  destroy (t);
+}
+
+// order of keys in bytes, as cedar::da::build () expects
+struct key_less {
+  const std::vector <const char*>& key;
+  const std::vector <size_t>&      len;
+  bool operator () (const size_t i, const size_t j) const {
+    const int r = std::memcmp (key[i], key[j], std::min (len[i], len[j]));
+    return r < 0 || (r == 0 && len[i] < len[j]);
   }
+};
+
+// build from a key file at once; see cedar::da::build (), which falls
+// back to update () for unsorted keys, so they are sorted here first
+template <typename T>
+void bench_build (const char* keys, const char* label) {
+  std::fprintf (stderr, "---- %-25s --------------------------\n", label);
+  char* data = 0;
+  const size_t size = read_data (keys, data);
+  std::vector <const char*> key;
+  std::vector <size_t>      len;
+  std::vector <int>         val;
+  for (char* start (data), *end (data), *tail (data + size);
+       end != tail; start = ++end) {
+    end = find_sep (end);
+    key.push_back (start);
+    len.push_back (end - start);
+    val.push_back (static_cast <int> (key.size ()));
+  }
+  std::vector <size_t> order (key.size ());
+  for (size_t i = 0; i < order.size (); ++i) order[i] = i;
+  const key_less less = { key, len };
+  if (! std::is_sorted (order.begin (), order.end (), less)) {
+    std::stable_sort (order.begin (), order.end (), less);
+    std::vector <const char*> key_ (key.size ());
+    std::vector <size_t>      len_ (key.size ());
+    std::vector <int>         val_ (key.size ());
+    for (size_t i = 0; i < order.size (); ++i)
+      key_[i] = key[order[i]], len_[i] = len[order[i]], val_[i] = val[order[i]];
+    key.swap (key_), len.swap (len_), val.swap (val_);
+    std::fprintf (stderr, "%-20s %s\n", "Keys:", "sorted before build");
+  }
+  T* t = create <T> ();
+  struct timeval st, et;
+  ::gettimeofday (&st, NULL);
+  t->build (key.size (), &key[0], &len[0], &val[0]);
+  ::gettimeofday (&et, NULL);
+  double elapsed = (et.tv_sec - st.tv_sec) + (et.tv_usec - st.tv_usec) * 1e-6;
+  std::fprintf (stderr, "%-20s %.2f sec (%.2f nsec per key; %.2f Mkeys/sec)\n",
+                "Time to build:", elapsed, elapsed * 1e9 / key.size (),
+                key.size () / elapsed * 1e-6);
+  std::fprintf (stderr, "%-20s %zu\n\n", "Words:", key.size ());
   destroy (t);
+  delete [] data;
 }
 
+#ifdef USE_PREFIX_TRIE
+// keys of a file split in memory, for the cedar-only benchmarks below
+struct key_set {
+  char* data;
+  std::vector <const char*> key;
+  std::vector <size_t>      len;
+  explicit key_set (const char* file) : data (0), key (), len () {
+    const size_t size = read_data (file, data);
+    for (char* start (data), *end (data), *tail (data + size);
+         end != tail; start = ++end) {
+      end = find_sep (end);
+      key.push_back (start);
+      len.push_back (end - start);
+    }
+  }
+  ~key_set () { delete [] data; }
+  // indices in a fixed random order, so that accesses jump over a trie
+  std::vector <size_t> shuffled () const {
+    std::vector <size_t> order (key.size ());
+    for (size_t i = 0; i < order.size (); ++i) order[i] = i;
+    unsigned x = 12345;
+    for (size_t i = order.size (); i > 1; --i)
+      std::swap (order[i - 1], order[(x = x * 1103515245 + 12345) % i]);
+    return order;
+  }
+private:
+  key_set (const key_set&);
+  key_set& operator= (const key_set&);
+};
+
+inline double elapsed_since (const struct timeval& st) {
+  struct timeval et;
+  ::gettimeofday (&et, NULL);
+  return (et.tv_sec - st.tv_sec) + (et.tv_usec - st.tv_usec) * 1e-6;
+}
+
+// lookup latency of a trie on 4KiB pages against huge pages; see
+// cedar::mmap_allocator, which falls back to 4KiB pages if none are given
+template <const int HUGE_PAGES>
+void bench_pages (const key_set& k, const key_set& q, const std::vector <size_t>& order, const char* label) {
+  typedef cedar::da <int, -1, -2, true, 1, 0, int, cedar::mmap_allocator <HUGE_PAGES> > trie_t;
+  std::fprintf (stderr, "---- %-25s --------------------------\n", label);
+  trie_t t;
+  for (size_t i = 0; i < k.key.size (); ++i)
+    t.update (k.key[i], k.len[i]) = static_cast <int> (i);
+  int n_ = 0;
+  struct timeval st;
+  ::gettimeofday (&st, NULL);
+  for (size_t i = 0; i < order.size (); ++i)
+    if (t.template exactMatchSearch <int> (q.key[order[i]], q.len[order[i]]) >= 0) ++n_;
+  const double elapsed = elapsed_since (st);
+  std::fprintf (stderr, "%-20s %.2f sec (%.2f nsec per key)\n",
+                "Time to search:", elapsed, elapsed * 1e9 / order.size ());
+  std::fprintf (stderr, "%-20s %d\n\n", "Found:", n_);
+}
+
+// the split layout (ninfo in its own array) against the fused one (ninfo
+// in each node) on a mix that inserts each key and then looks up r keys
+// inserted so far; r = 0 is insert-only and a large r lookup-heavy
+template <const bool FUSED>
+void bench_mix (const key_set& k, const size_t r, const char* label) {
+  typedef cedar::da <int, -1, -2, true, 1, 0, int, cedar::default_allocator, FUSED> trie_t;
+  trie_t t;
+  int n_ = 0;
+  unsigned x = 12345;
+  struct timeval st;
+  ::gettimeofday (&st, NULL);
+  for (size_t i = 0; i < k.key.size (); ++i) {
+    t.update (k.key[i], k.len[i]) = static_cast <int> (i);
+    for (size_t j = 0; j < r; ++j) {
+      const size_t l = (x = x * 1103515245 + 12345) % (i + 1);
+      if (t.template exactMatchSearch <int> (k.key[l], k.len[l]) >= 0) ++n_;
+    }
+  }
+  const double elapsed = elapsed_since (st);
+  char name[32];
+  std::sprintf (name, "Time (1:%zu mix):", r);
+  std::fprintf (stderr, "%-20s %.2f sec (%.2f nsec per op; %s)\n",
+                name, elapsed, elapsed * 1e9 / (k.key.size () * (r + 1)), label);
+  if (static_cast <size_t> (n_) != k.key.size () * r)
+    std::fprintf (stderr, "mixed lookup missed\n");
+}
+
+// the longest key prefixing each query, in one walk against the last
+// result of commonPrefixSearch ()
+void bench_prefix (const key_set& k, const key_set& q) {
+  typedef cedar_t::result_pair_type result_t;
+  std::fprintf (stderr, "---- %-25s --------------------------\n", "cedar (longest prefix)");
+  cedar_t t;
+  for (size_t i = 0; i < k.key.size (); ++i)
+    t.update (k.key[i], k.len[i]) = static_cast <int> (i);
+  const size_t n = q.key.size ();
+  std::vector <result_t> longest (n), common (n);
+  struct timeval st;
+  ::gettimeofday (&st, NULL);
+  for (size_t i = 0; i < n; ++i)
+    longest[i] = t.longestPrefixSearch <result_t> (q.key[i], q.len[i]);
+  double elapsed = elapsed_since (st);
+  std::fprintf (stderr, "%-20s %.2f sec (%.2f nsec per key)\n",
+                "Time to longest:", elapsed, elapsed * 1e9 / n);
+  result_t result[256];
+  ::gettimeofday (&st, NULL);
+  for (size_t i = 0; i < n; ++i) {
+    const size_t m = std::min (t.commonPrefixSearch (q.key[i], result, 256, q.len[i]), static_cast <size_t> (256));
+    if (m) common[i] = result[m - 1];
+    else common[i].value = cedar_t::CEDAR_NO_VALUE, common[i].length = 0;
+  }
+  elapsed = elapsed_since (st);
+  std::fprintf (stderr, "%-20s %.2f sec (%.2f nsec per key)\n",
+                "Time to common:", elapsed, elapsed * 1e9 / n);
+  size_t found = 0, mismatched = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (longest[i].value != cedar_t::CEDAR_NO_VALUE) ++found;
+    if (longest[i].value != common[i].value || longest[i].length != common[i].length) ++mismatched;
+  }
+  std::fprintf (stderr, "%-20s %zu\n\n", "Found:", found);
+  if (mismatched) std::fprintf (stderr, "longest prefix mismatched: %zu\n", mismatched);
+}
+
+// keys within max_distance edits of each of the first num queries; the
+// time grows with the edits allowed rather than with the keys
+void bench_fuzzy (const key_set& k, const key_set& q, const size_t max_distance, const size_t num) {
+  typedef cedar_t::result_triple_type result_t;
+  cedar_t t;
+  for (size_t i = 0; i < k.key.size (); ++i)
+    t.update (k.key[i], k.len[i]) = static_cast <int> (i);
+  const size_t n = std::min (num, q.key.size ());
+  std::vector <result_t> result (1024);
+  size_t found = 0;
+  struct timeval st;
+  ::gettimeofday (&st, NULL);
+  for (size_t i = 0; i < n; ++i)
+    found += t.fuzzySearch (q.key[i], &result[0], result.size (), q.len[i], max_distance);
+  const double elapsed = elapsed_since (st);
+  char name[32];
+  std::sprintf (name, "Time (k = %zu):", max_distance);
+  std::fprintf (stderr, "%-20s %.2f sec (%.2f usec per key; %.2f keys found)\n",
+                name, elapsed, elapsed * 1e6 / n, static_cast <double> (found) / n);
+}
+#endif
+
 int main (int argc, char** argv) {
   if (argc < 3)
     { std::fprintf (stderr, "Usage: %s keys queries\n", argv[0]); std::exit (1); }
@@ -415,6 +651,44 @@ int main (int argc, char** argv) {
 #else
   bench <cedar_t>   (argv[1], argv[2], "cedar");
 #endif
+  bench_build <cedar_t> (argv[1], "cedar (build)");
+#endif
+#if defined (USE_CEDAR_HUGE_PAGES) && defined (USE_PREFIX_TRIE)
+  { // queries in random order
+    const key_set k (argv[1]), q (argv[2]);
+    const std::vector <size_t> order = q.shuffled ();
+    bench_pages <0> (k, q, order, "cedar (4KiB pages)");
+    bench_pages <1> (k, q, order, "cedar (THP; madvise)");
+    bench_pages <2> (k, q, order, "cedar (hugetlbfs)");
+  }
+#endif
+#if defined (USE_CEDAR_FUSED) && defined (USE_PREFIX_TRIE)
+  { // 1 insert to r lookups
+    const key_set k (argv[1]);
+    std::fprintf (stderr, "---- %-25s --------------------------\n", "cedar (split vs fused)");
+    const size_t r[] = { 0, 1, 16 };
+    for (size_t i = 0; i < sizeof (r) / sizeof (r[0]); ++i) {
+      bench_mix <false> (k, r[i], "split");
+      bench_mix <true>  (k, r[i], "fused");
+    }
+    std::fprintf (stderr, "\n");
+  }
+#endif
+#if defined (USE_CEDAR_LONGEST) && defined (USE_PREFIX_TRIE)
+  { // queries as texts whose prefixes are keys
+    const key_set k (argv[1]), q (argv[2]);
+    bench_prefix (k, q);
+  }
+#endif
+#if defined (USE_CEDAR_FUZZY) && defined (USE_PREFIX_TRIE)
+  { // the first 1000 queries against all keys
+    const key_set k (argv[1]), q (argv[2]);
+    std::fprintf (stderr, "---- %-25s --------------------------\n", "cedar (fuzzy)");
+    std::fprintf (stderr, "%-20s %zu\n", "Words:", k.key.size ());
+    bench_fuzzy (k, q, 1, 1000);
+    bench_fuzzy (k, q, 2, 1000);
+    std::fprintf (stderr, "\n");
+  }
 #endif
 #ifdef USE_CEDAR_UNORDERED
 #if   defined (USE_PREFIX_TRIE)
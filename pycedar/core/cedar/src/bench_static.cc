@@ -41,6 +41,9 @@ typedef cedar::da <int, -1, -2, false>  cedar_t;
 #else
 typedef cedar::da <int>                 cedar_t;
 #endif
+#ifdef USE_PREFIX_TRIE
+class cedar_frozen_t : public cedar_t {}; // freeze () before save ()
+#endif
 typedef Trie                            Trie_t;
 typedef dutil::trie                     trie_t;
 typedef Darts::DoubleArray              darts_t;
@@ -135,9 +138,9 @@ void build (int fd, int& n, const char* index) {
 }
 
 // cedar
-template <>
-void build <cedar_t> (int fd, int& n, const char* index) {
-  cedar_t* t = create <cedar_t> ();
+template <typename T>
+T* build_cedar (int fd, int& n) {
+  T* t = create <T> ();
   char data[BUFFER_SIZE];
   char* start (data), *end (data), *tail (data + BUFFER_SIZE - 1), *tail_ (data);
   while ((tail_ = end + ::read (fd, end, tail - end)) != end) {
@@ -146,10 +149,26 @@ void build <cedar_t> (int fd, int& n, const char* index) {
     std::memmove (data, start, tail_ - start);
     end = data + (tail_ - start); start = data;
   }
+  return t;
+}
+
+template <>
+void build <cedar_t> (int fd, int& n, const char* index) {
+  cedar_t* t = build_cedar <cedar_t> (fd, n);
   t->save (index);
   destroy (t);
 }
 
+#ifdef USE_PREFIX_TRIE
+template <>
+void build <cedar_frozen_t> (int fd, int& n, const char* index) {
+  cedar_frozen_t* t = build_cedar <cedar_frozen_t> (fd, n);
+  t->freeze ();
+  t->save (index);
+  destroy (t);
+}
+#endif
+
 // libdatrie
 template <>
 void build <Trie_t> (int fd, int& n, const char* index) {
@@ -449,6 +468,9 @@ int main (int argc, char** argv) {
   bench <cedar_t>   (argv[1], argv[2], argv[3], "cedar");
 #endif
 #endif
+#if defined (USE_CEDAR_FROZEN) && defined (USE_PREFIX_TRIE)
+  bench <cedar_frozen_t> (argv[1], argv[2], argv[3], "cedar (frozen)");
+#endif
 #ifdef USE_CEDAR_UNORDERED
 #if   defined (USE_PREFIX_TRIE)
   bench <cedar_t>   (argv[1], argv[2], argv[3], "cedar unordered (prefix)");
@@ -491,5 +513,6 @@ int main (int argc, char** argv) {
 }
 /*
   g++ -DUSE_CEDAR -DHAVE_CONFIG_H -I. -I.. -I$HOME/local/include -O2 -g bench_static.cc -o bench_static_marisa -L$HOME/local/lib -ltx -lux -lmarisa -ltrie
+  g++ -DUSE_CEDAR -DUSE_CEDAR_FROZEN -DUSE_PREFIX_TRIE -DUSE_DARTS_CLONE -DUSE_MARISA -DHAVE_CONFIG_H -I. -I.. -I$HOME/local/include -O2 -g bench_static.cc -o bench_static_frozen -L$HOME/local/lib -ltx -lux -lmarisa -ltrie
   g++ -DUSE_CEDAR -DHAVE_CONFIG_H -DUSE_BINARY_DATA -I. -I.. -I$HOME/local/include -O2 -g bench_static.cc -o bench_static_marisa_bin -L$HOME/local/lib -ltx -lux -lmarisa -ltrie
 */
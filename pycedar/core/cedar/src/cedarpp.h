@@ -10,12 +10,37 @@
 #include <climits>
 #include <cassert>
 #include <stdexcept> // std::runtime_error
+#include <algorithm> // std::sort
+#ifndef _WIN32
+#include <sys/mman.h> // mmap
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#if defined (USE_MREMAP) && ! defined (__linux__)
+#error "USE_MREMAP requires mremap () of Linux"
+#endif
+#if __cplusplus >= 201103L
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <string>
+#endif
+#if defined (__GNUC__) && defined (__SSE2__)
+#include <immintrin.h> // SSE2/AVX2 for comparing suffixes
+#endif
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
 #define STATIC_ASSERT(e, msg) typedef char msg[(e) ? 1 : -1]
+#ifdef USE_STATS // count events on update paths; see da::stats ()
+#define CEDAR_STAT(e) e
+#else
+#define CEDAR_STAT(e)
+#endif
 
 namespace cedar {
   // typedefs
@@ -29,18 +54,562 @@ namespace cedar {
   static const npos_t NODE_INDEX_MASK  = static_cast <npos_t> (0xffffffff) << 32;
   template <typename T> struct NaN { enum { N1 = -1, N2 = -2 }; };
   template <> struct NaN <float> { enum { N1 = 0x7f800001, N2 = 0x7f800002 }; };
+  // what a node keeps for a value; a value wider than int lives in _tail
+  // and the node keeps its offset
+  template <typename T, typename I, const bool = (sizeof (T) > sizeof (int))>
+  struct node_value { typedef T type; };
+  template <typename T, typename I> struct node_value <T, I, true> { typedef I type; };
+  // memory policies for the arrays of da; a policy provides
+  //   static void* reallocate (void* p, size_t size, size_t& dirty);
+  //   static void  release (void* p);
+  // reallocate () resizes p (or allocates if p is 0) to size bytes and
+  // returns 0 on failure; dirty is set to the bytes that may be nonzero,
+  // past which the region reads zero (size if unknown)
+  struct malloc_allocator {
+    static void* reallocate (void* p, const size_t size, size_t& dirty)
+    { dirty = size; return std::realloc (p, size); }
+    static void release (void* p) { std::free (p); }
+  };
+#ifndef _WIN32
+  // arrays on anonymous mappings; on Linux, growth remaps pages and never
+  // copies them, while untouched pages read zero and cost nothing.
+  // HUGE_PAGES = 1 asks for transparent huge pages with madvise (), and 2
+  // maps hugetlbfs pages (HUGE_PAGE_SIZE each; 1 if none are reserved),
+  // which spares lookups on large tries most of their TLB misses
+  static const size_t HUGE_PAGE_SIZE = 1 << 21; // default of x86-64
+  template <const int HUGE_PAGES = 0>
+  struct mmap_allocator {
+    static void* reallocate (void* p, const size_t size, size_t& dirty) {
+      char* q = p ? static_cast <char*> (p) - HEAD : 0;
+      size_t h[2] = { 0, 0 }; // bytes in use and page size of the mapping
+      if (q) std::memcpy (h, q, sizeof (h));
+      const size_t len = HEAD + size;
+      if (q && len < h[0]) // clear the rest of the last page, which growth may expose
+        std::memset (q + len, 0, (_round (len, h[1]) < h[0] ? _round (len, h[1]) : h[0]) - len);
+      if (! q) q = _map (len, h[1]);
+      else if (_round (len, h[1]) != _round (h[0], h[1])) q = _remap (q, h[0], len, h[1]);
+      if (! q) return 0;
+      dirty = h[0] ? h[0] - HEAD : 0;
+      h[0] = len;
+      std::memcpy (q, h, sizeof (h));
+      return q + HEAD;
+    }
+    static void release (void* p) {
+      if (! p) return;
+      char* const q = static_cast <char*> (p) - HEAD;
+      size_t h[2];
+      std::memcpy (h, q, sizeof (h));
+      ::munmap (q, _round (h[0], h[1]));
+    }
+  private:
+    enum { HEAD = 16 }; // keeps the bytes in use and page size
+    static size_t _round (const size_t n, const size_t page)
+    { return (n + page - 1) / page * page; }
+    static char* _map (const size_t len, size_t& page) {
+      void* r = MAP_FAILED;
+#ifdef MAP_HUGETLB
+      if (HUGE_PAGES == 2)
+        r = ::mmap (0, _round (len, page = HUGE_PAGE_SIZE), PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+      if (r == MAP_FAILED) {
+        page = static_cast <size_t> (::sysconf (_SC_PAGESIZE));
+        r = ::mmap (0, _round (len, page), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (r == MAP_FAILED) return 0;
+        _advise (r, _round (len, page));
+      }
+      return static_cast <char*> (r);
+    }
+    static char* _remap (char* q, const size_t len_, const size_t len, size_t& page) {
+#ifdef __linux__
+      void* const r = ::mremap (q, _round (len_, page), _round (len, page), MREMAP_MAYMOVE);
+      if (r == MAP_FAILED) return 0;
+      if (page != HUGE_PAGE_SIZE) _advise (r, _round (len, page));
+      return static_cast <char*> (r);
+#else
+      const size_t page_ = page;
+      char* const r = _map (len, page);
+      if (! r) return 0;
+      std::memcpy (r, q, len_ < len ? len_ : len);
+      ::munmap (q, _round (len_, page_));
+      return r;
+#endif
+    }
+    static void _advise (void* r, const size_t len) {
+#ifdef MADV_HUGEPAGE
+      if (HUGE_PAGES) ::madvise (r, len, MADV_HUGEPAGE);
+#else
+      (void) r, (void) len;
+#endif
+    }
+  };
+#endif
+#if __cplusplus >= 201103L
+  // arrays of all tries with the same tag are carved from a shared pool of
+  // CHUNK_SIZE-byte chunks, which packs many small tries (e.g., one per
+  // tenant) together and spares malloc () their churn; freed blocks are
+  // kept on size-class lists for reuse and the chunks are freed at exit.
+  // regions over CHUNK_SIZE / 4 bytes go to malloc ()
+  template <typename tag = void, const size_t CHUNK_SIZE = 1 << 20>
+  class arena_allocator {
+  public:
+    static void* reallocate (void* p, const size_t size, size_t& dirty) {
+      dirty = size;
+      size_t h[2] = { 0, 0 }; // class (LARGE for malloc ()) and size
+      if (p) std::memcpy (h, static_cast <char*> (p) - HEAD, sizeof (h));
+      const size_t c = _class (size);
+      if (p && c == h[0] && c != LARGE) { // fits in place
+        h[1] = size;
+        std::memcpy (static_cast <char*> (p) - HEAD, h, sizeof (h));
+        return p;
+      }
+      char* q = 0;
+      if (p && c == LARGE && h[0] == LARGE)
+        q = static_cast <char*> (std::realloc (static_cast <char*> (p) - HEAD, HEAD + size));
+      else {
+        if (! (q = _allocate (c, size))) return 0;
+        if (p) std::memcpy (q + HEAD, p, h[1] < size ? h[1] : size), release (p);
+      }
+      if (! q) return 0;
+      h[0] = c, h[1] = size;
+      std::memcpy (q, h, sizeof (h));
+      return q + HEAD;
+    }
+    static void release (void* p) {
+      if (! p) return;
+      char* const q = static_cast <char*> (p) - HEAD;
+      size_t c = 0;
+      std::memcpy (&c, q, sizeof (size_t));
+      if (c == LARGE) { std::free (q); return; }
+      arena& a = _arena ();
+      std::lock_guard <std::mutex> lock (a.mutex);
+      _push (a, q, c);
+    }
+  private:
+    enum { HEAD = 16, LARGE = 0, MIN_CLASS = 5 }; // blocks of 1 << class bytes
+    enum { NUM_CLASSES = sizeof (size_t) * CHAR_BIT };
+    STATIC_ASSERT(CHUNK_SIZE >= 4 << MIN_CLASS, chunk_size_is_too_small);
+    struct arena {
+      std::mutex           mutex;
+      std::vector <char*>  chunk;
+      char*                head;  // of unused space in the last chunk
+      size_t               left;
+      char*                free[NUM_CLASSES];
+      arena () : mutex (), chunk (), head (0), left (0), free () {}
+      ~arena () { for (size_t i = 0; i < chunk.size (); ++i) std::free (chunk[i]); }
+    };
+    static arena& _arena () { static arena a; return a; }
+    static size_t _class (const size_t size) {
+      if (HEAD + size > CHUNK_SIZE / 4) return LARGE;
+      size_t c = MIN_CLASS;
+      while ((static_cast <size_t> (1) << c) < HEAD + size) ++c;
+      return c;
+    }
+    static void _push (arena& a, char* q, const size_t c)
+    { std::memcpy (q + HEAD, &a.free[c], sizeof (char*)); a.free[c] = q; }
+    static char* _allocate (const size_t c, const size_t size) {
+      if (c == LARGE) return static_cast <char*> (std::malloc (HEAD + size));
+      const size_t n = static_cast <size_t> (1) << c;
+      arena& a = _arena ();
+      std::lock_guard <std::mutex> lock (a.mutex);
+      char* q = a.free[c];
+      if (q) {
+        std::memcpy (&a.free[c], q + HEAD, sizeof (char*));
+        return q;
+      }
+      if (a.left < n) { // file the rest of the chunk by class and start a new one
+        for (size_t c_ = c - 1; c_ >= MIN_CLASS; --c_) {
+          const size_t n_ = static_cast <size_t> (1) << c_;
+          if (a.left >= n_) _push (a, a.head, c_), a.head += n_, a.left -= n_;
+        }
+        if (! (q = static_cast <char*> (std::malloc (CHUNK_SIZE)))) return 0;
+        a.chunk.push_back (q);
+        a.head = q, a.left = CHUNK_SIZE;
+      }
+      q = a.head, a.head += n, a.left -= n;
+      return q;
+    }
+  };
+#endif
+#ifdef USE_MREMAP
+  typedef mmap_allocator <> default_allocator;
+#else
+  typedef malloc_allocator  default_allocator;
+#endif
+  // where a node finds its ninfo; in _ninfo by default, or in the node
+  // itself (FUSED), which lets updates touch one cache line per node
+  // instead of two but makes nodes 4 or 8 bytes larger for lookups
+  template <typename T, const bool> struct node_info
+  { T& info (T* ninfo, const npos_t i) { return ninfo[i]; } };
+  template <typename T> struct node_info <T, true>
+  { T info_; T& info (T*, npos_t) { return info_; } };
   static const int MAX_ALLOC_SIZE = 1 << 16; // must be divisible by 256
+  // byte-level DFA for da::patternSearch (), compiled from a glob (* ? [a-z]
+  // [!a-z] \x) or a regex (. [a-z] [^a-z] * + ? | ( ) \d \w \s \x; ^ and $
+  // are implied) by the positions of its symbols (Glushkov); a pattern
+  // matches whole keys.  state 0 is the start, and -1 where no key matches
+  // any more
+  class dfa {
+  public:
+    enum syntax_type { GLOB, REGEX };
+    static const int MAX_STATES = 1 << 16;
+    dfa () : _next (0), _label (0), _num_labels (0), _accept (0), _num_states (0) {}
+    explicit dfa (const char* pattern, const syntax_type syntax = GLOB) :
+      _next (0), _label (0), _num_labels (0), _accept (0), _num_states (0)
+    { compile (pattern, std::strlen (pattern), syntax); }
+    ~dfa () { clear (); }
+    void clear () {
+      std::free (_next);
+      std::free (_label);
+      std::free (_num_labels);
+      std::free (_accept);
+      _next = 0, _label = 0, _num_labels = 0, _accept = 0, _num_states = 0;
+    }
+    // throw std::runtime_error for a bad pattern or too many states
+    void compile (const char* pattern, const size_t len, const syntax_type syntax = GLOB) {
+      clear ();
+      builder b (pattern, len, syntax);
+      try { b.build (*this); } catch (...) { clear (); throw; }
+    }
+    int  num_states () const { return _num_states; }
+    int  next (const int s, const uchar c) const { return _next[(s << 8) | c]; }
+    bool accept (const int s) const { return _accept[s]; }
+    // bytes not leading to -1 from s, in order
+    const uchar* labels (const int s) const { return &_label[s << 8]; }
+    int num_labels (const int s) const { return _num_labels[s]; }
+  private:
+    dfa (const dfa&);
+    dfa& operator= (const dfa&);
+    int*   _next;       // 256 per state
+    uchar* _label;      // 256 per state
+    int*   _num_labels;
+    bool*  _accept;
+    int    _num_states;
+    template <typename T>
+    static void _grow (T*& p, const size_t n) {
+      T* const q = static_cast <T*> (std::realloc (p, sizeof (T) * n));
+      if (! q) throw std::runtime_error ("memory allocation failed");
+      p = q;
+    }
+    // first and last positions of a subpattern, as sets at i and i + 1
+    struct frag { size_t i; bool nullable; };
+    class builder {
+    public:
+      builder (const char* pattern, const size_t len, const syntax_type syntax) :
+        _p (pattern), _end (pattern + len), _syntax (syntax),
+        _words ((len + 1) / 32 + 1), _num (0), _top (0), _sym (0), _follow (0), _stack (0) {
+        if (syntax == REGEX) { // drop anchors
+          if (_p < _end && *_p == '^') ++_p;
+          size_t n = 0;
+          for (const char* q = _end - 1; q > _p && *(q - 1) == '\\'; --q) ++n;
+          if (_end > _p && *(_end - 1) == '$' && ! (n & 1)) --_end;
+        }
+        _grow (_sym,    8 * (len + 1));
+        _grow (_follow, _words * (len + 1));
+        _grow (_stack,  _words * 2 * (2 * len + 4)); // three per nesting at most
+        std::memset (_follow, 0, sizeof (unsigned) * _words * (len + 1));
+      }
+      ~builder () { std::free (_sym); std::free (_follow); std::free (_stack); }
+      void build (dfa& d) {
+        frag r = _syntax == GLOB ? _glob () : _alt ();
+        if (_p != _end) throw std::runtime_error ("unbalanced ) in pattern");
+        std::memcpy (&_follow[0], _set (r.i), sizeof (unsigned) * _words); // from the start
+        unsigned* const last = _set (r.i + 1);
+        if (r.nullable) last[0] |= 1;
+        _subset (d, last);
+      }
+    private:
+      builder (const builder&);
+      builder& operator= (const builder&);
+      const char* _p;
+      const char* _end;
+      syntax_type _syntax;
+      size_t      _words;  // per set of positions
+      size_t      _num;    // positions so far; 0 stands for the start
+      size_t      _top;    // sets in use on _stack
+      unsigned*   _sym;    // bytes each position takes, 8 words each
+      unsigned*   _follow; // positions that may follow each position
+      unsigned*   _stack;  // first and last positions of subpatterns
+      unsigned* _set (const size_t i) { return &_stack[i * _words]; }
+      static bool _has (const unsigned* s, const size_t i) { return (s[i >> 5] >> (i & 31)) & 1; }
+      void _or (unsigned* s, const unsigned* t) { for (size_t i = 0; i < _words; ++i) s[i] |= t[i]; }
+      frag _empty () {
+        frag f = { _top, true };
+        _top += 2;
+        std::memset (_set (f.i), 0, sizeof (unsigned) * _words * 2);
+        return f;
+      }
+      frag _symbol (const unsigned* bytes) {
+        const size_t q = ++_num;
+        std::memcpy (&_sym[q * 8], bytes, sizeof (unsigned) * 8);
+        _sym[q * 8] &= ~1u; // keys have no '\0'
+        frag f = _empty ();
+        f.nullable = false;
+        _set (f.i)[q >> 5] |= 1u << (q & 31), _set (f.i + 1)[q >> 5] |= 1u << (q & 31);
+        return f;
+      }
+      void _follows (const frag& a, const frag& b) { // last (a) followed by first (b)
+        const unsigned* const last = _set (a.i + 1);
+        for (size_t q = 0; q <= _num; ++q)
+          if (_has (last, q)) _or (&_follow[q * _words], _set (b.i));
+      }
+      void _concat (frag& a, const frag& b) { // b is on top of a
+        _follows (a, b);
+        if (a.nullable) _or (_set (a.i), _set (b.i));
+        if (b.nullable) _or (_set (a.i + 1), _set (b.i + 1));
+        else std::memcpy (_set (a.i + 1), _set (b.i + 1), sizeof (unsigned) * _words);
+        a.nullable = a.nullable && b.nullable;
+        _top = b.i;
+      }
+      void _union (frag& a, const frag& b) {
+        _or (_set (a.i), _set (b.i));
+        _or (_set (a.i + 1), _set (b.i + 1));
+        a.nullable = a.nullable || b.nullable;
+        _top = b.i;
+      }
+      // glob
+      frag _glob () {
+        frag a = _empty ();
+        while (_p < _end) {
+          unsigned bytes[8] = { 0 };
+          const char c = *_p++;
+          if (c == '*' || c == '?') std::memset (bytes, 0xff, sizeof (bytes));
+          else if (c == '\\' && _p < _end) _add (bytes, *_p++);
+          else if (c != '[' || ! _class (bytes)) _add (bytes, c); // [ if unclosed
+          frag b = _symbol (bytes);
+          if (c == '*') _follows (b, b), b.nullable = true;
+          _concat (a, b);
+        }
+        return a;
+      }
+      // regex
+      frag _alt () {
+        frag a = _cat ();
+        while (_p < _end && *_p == '|') {
+          ++_p;
+          frag b = _cat ();
+          _union (a, b);
+        }
+        return a;
+      }
+      frag _cat () {
+        frag a = _empty ();
+        while (_p < _end && *_p != '|' && *_p != ')') {
+          frag b = _rep ();
+          _concat (a, b);
+        }
+        return a;
+      }
+      frag _rep () {
+        frag a = _atom ();
+        if (_p < _end && (*_p == '*' || *_p == '+' || *_p == '?')) {
+          if (*_p != '?') _follows (a, a);
+          if (*_p != '+') a.nullable = true;
+          if (++_p < _end && *_p == '?') ++_p; // lazy, for the same keys
+          if (_p < _end && (*_p == '*' || *_p == '+' || *_p == '?'))
+            throw std::runtime_error ("multiple repeat in pattern");
+        }
+        return a;
+      }
+      frag _atom () {
+        unsigned bytes[8] = { 0 };
+        const char c = *_p++;
+        switch (c) {
+          case '(': {
+            frag a = _alt ();
+            if (_p == _end || *_p != ')') throw std::runtime_error ("missing ) in pattern");
+            ++_p;
+            return a;
+          }
+          case '*': case '+': case '?':
+            throw std::runtime_error ("nothing to repeat in pattern");
+          case '.': std::memset (bytes, 0xff, sizeof (bytes)); break;
+          case '[':
+            if (! _class (bytes)) throw std::runtime_error ("missing ] in pattern");
+            break;
+          case '\\':
+            if (_p == _end) throw std::runtime_error ("trailing \\ in pattern");
+            if (! _escape (bytes, *_p)) _add (bytes, *_p);
+            ++_p;
+            break;
+          default: _add (bytes, c);
+        }
+        return _symbol (bytes);
+      }
+      static void _add (unsigned* bytes, const char c) {
+        const uchar b = static_cast <uchar> (c);
+        bytes[b >> 5] |= 1u << (b & 31);
+      }
+      // \d \w \s and their complements in ASCII; false for others
+      static bool _escape (unsigned* bytes, const char c) {
+        unsigned t[8] = { 0 };
+        switch (c | 0x20) {
+          case 'd': for (char b = '0'; b <= '9'; ++b) _add (t, b); break;
+          case 'w':
+            for (char b = '0'; b <= '9'; ++b) _add (t, b);
+            for (char b = 'a'; b <= 'z'; ++b) _add (t, b), _add (t, static_cast <char> (b - 0x20));
+            _add (t, '_');
+            break;
+          case 's': for (const char* b = " \t\n\r\f\v"; *b; ++b) _add (t, *b); break;
+          default: return false;
+        }
+        for (int i = 0; i < 8; ++i) bytes[i] |= c & 0x20 ? t[i] : ~t[i];
+        return true;
+      }
+      // bytes in [...] after '[' into bytes; false, leaving bytes as is,
+      // if no ] closes it
+      bool _class (unsigned* bytes) {
+        unsigned set[8] = { 0 };
+        const char* p = _p;
+        const bool negate = p < _end && (*p == '^' || (*p == '!' && _syntax == GLOB));
+        if (negate) ++p;
+        for (bool head = true; p < _end && (head || *p != ']'); head = false) {
+          uchar lo = static_cast <uchar> (*p++);
+          if (lo == '\\' && p < _end) {
+            if (_syntax == REGEX && _escape (set, *p)) { ++p; continue; }
+            lo = static_cast <uchar> (*p++);
+          }
+          uchar hi = lo;
+          if (p + 1 < _end && *p == '-' && p[1] != ']') {
+            hi = static_cast <uchar> (*++p), ++p;
+            if (hi == '\\' && p < _end) hi = static_cast <uchar> (*p++);
+          }
+          for (int b = lo; b <= hi; ++b) set[b >> 5] |= 1u << (b & 31);
+        }
+        if (p == _end) return false;
+        _p = p + 1;
+        for (int i = 0; i < 8; ++i) bytes[i] |= negate ? ~set[i] : set[i];
+        return true;
+      }
+      // states as sets of positions read last, by subset construction
+      void _subset (dfa& d, const unsigned* last) {
+        unsigned* sets = 0;   // positions of each state
+        unsigned* next = 0;   // positions to go by each byte
+        int*      hash = 0;   // open addressing on states
+        size_t    hash_size = 256;
+        size_t    capacity  = 16; // states
+        try {
+          _grow (next, 257 * _words); // and the union of follows
+          _grow (hash, hash_size);
+          for (size_t i = 0; i < hash_size; ++i) hash[i] = -1;
+          _grow (sets, capacity * _words);
+          _grow (d._next, capacity << 8);
+          _grow (d._accept, capacity);
+          std::memset (sets, 0, sizeof (unsigned) * _words);
+          sets[0] = 1; // the start
+          d._num_states = 1;
+          hash[_hash (sets) & (hash_size - 1)] = 0;
+          for (int s = 0; s < d._num_states; ++s) {
+            std::memset (next, 0, sizeof (unsigned) * 257 * _words);
+            const unsigned* const set = &sets[s * _words];
+            unsigned* const follow = &next[256 * _words];
+            d._accept[s] = false;
+            for (size_t q = 0; q <= _num; ++q)
+              if (_has (set, q)) {
+                if (_has (last, q)) d._accept[s] = true;
+                _or (follow, &_follow[q * _words]);
+              }
+            for (size_t p = 1; p <= _num; ++p)
+              if (_has (follow, p))
+                for (size_t c = 1; c < 256; ++c)
+                  if (_has (&_sym[p * 8], c))
+                    next[c * _words + (p >> 5)] |= 1u << (p & 31);
+            d._next[s << 8] = -1;
+            for (int c = 1; c < 256; ++c) {
+              const unsigned* const t = &next[c * _words];
+              size_t i = 0;
+              while (i < _words && ! t[i]) ++i;
+              if (i == _words) { d._next[(s << 8) | c] = -1; continue; }
+              size_t h = _hash (t) & (hash_size - 1);
+              for (; hash[h] >= 0; h = (h + 1) & (hash_size - 1))
+                if (! std::memcmp (&sets[hash[h] * _words], t, sizeof (unsigned) * _words)) break;
+              if (hash[h] >= 0) { d._next[(s << 8) | c] = hash[h]; continue; }
+              if (d._num_states == MAX_STATES) throw std::runtime_error ("too many states for pattern");
+              const int n = d._num_states++; // a new state
+              if (static_cast <size_t> (d._num_states) > capacity) {
+                capacity <<= 1;
+                _grow (sets, capacity * _words);
+                _grow (d._next, capacity << 8);
+                _grow (d._accept, capacity);
+              }
+              std::memcpy (&sets[n * _words], t, sizeof (unsigned) * _words);
+              d._next[(s << 8) | c] = hash[h] = n;
+              if (static_cast <size_t> (d._num_states) * 2 > hash_size)
+                _rehash (hash, hash_size, sets, d._num_states);
+            }
+          }
+        } catch (...) {
+          std::free (sets); std::free (next); std::free (hash);
+          throw;
+        }
+        std::free (sets); std::free (next); std::free (hash);
+        _prune (d);
+      }
+      size_t _hash (const unsigned* s) const {
+        size_t h = 0;
+        for (size_t i = 0; i < _words; ++i) h = h * 0x9e3779b1 + s[i];
+        return h ^ (h >> 16);
+      }
+      void _rehash (int*& hash, size_t& hash_size, const unsigned* sets, const int n) {
+        hash_size <<= 1;
+        _grow (hash, hash_size);
+        for (size_t i = 0; i < hash_size; ++i) hash[i] = -1;
+        for (int s = 0; s < n; ++s) {
+          size_t h = _hash (&sets[s * _words]) & (hash_size - 1);
+          while (hash[h] >= 0) h = (h + 1) & (hash_size - 1);
+          hash[h] = s;
+        }
+      }
+      // send bytes to -1 where no accepting state is reachable, and list
+      // the rest as labels
+      static void _prune (dfa& d) {
+        const int n = d._num_states;
+        bool* live = 0;
+        _grow (live, static_cast <size_t> (n));
+        for (int s = 0; s < n; ++s) live[s] = d._accept[s];
+        for (bool changed = true; changed; ) {
+          changed = false;
+          for (int s = 0; s < n; ++s)
+            for (int c = 1; ! live[s] && c < 256; ++c) {
+              const int t = d._next[(s << 8) | c];
+              if (t >= 0 && live[t]) live[s] = changed = true;
+            }
+        }
+        try {
+          _grow (d._label, static_cast <size_t> (n) << 8);
+          _grow (d._num_labels, static_cast <size_t> (n));
+        } catch (...) { std::free (live); throw; }
+        for (int s = 0; s < n; ++s) {
+          int* const to = &d._next[s << 8];
+          int m = 0;
+          for (int c = 1; c < 256; ++c)
+            if (to[c] >= 0 && ! live[to[c]]) to[c] = -1;
+            else if (to[c] >= 0) d._label[(s << 8) | m++] = static_cast <uchar> (c);
+          d._num_labels[s] = m;
+        }
+        std::free (live);
+      }
+    };
+  };
+  template <typename, const size_t, const size_t> class sharded_da;
+  template <typename> class aho_corasick;
+  template <typename> class top_k;
   // dynamic double array
   template <typename value_type,
             const int     NO_VALUE  = NaN <value_type>::N1,
             const int     NO_PATH   = NaN <value_type>::N2,
             const bool    ORDERED   = true,
             const int     MAX_TRIAL = 1,
-            const size_t  NUM_TRACKING_NODES = 0>
+            const size_t  NUM_TRACKING_NODES = 0,
+            typename      index_type = int, // or a 64-bit type for huge tries
+            typename      allocator_type = default_allocator, // see malloc_allocator
+            const bool    FUSED = false> // keep ninfo in node; see node_info
   class da {
   public:
     enum error_code { CEDAR_NO_VALUE = NO_VALUE, CEDAR_NO_PATH = NO_PATH };
     typedef value_type result_type;
+    typedef typename node_value <value_type, index_type>::type slot_type;
+    typedef index_type node_index; // as returned by begin () and next ()
     struct result_pair_type {
       value_type  value;
       size_t      length;  // prefix length
@@ -50,30 +619,77 @@ namespace cedar {
       size_t      length;  // suffix length
       npos_t      id;      // node id of value
     };
-    struct node {
-      union { int base; value_type value; }; // negative means prev empty index
-      int  check;                            // negative means next empty index
-      node (const int base_ = 0, const int check_ = 0)
-        : base (base_), check (check_) {}
+    enum { NUM_RELOCATION_BINS = 10 };
+    enum block_list { BLOCK_FULL, BLOCK_CLOSED, BLOCK_OPEN };
+    struct stats_type { // for stats (); all zero unless USE_STATS
+      size_t resolve;           // conflicts resolved
+      size_t relocated;         // nodes moved to resolve conflicts
+      size_t block_scans;       // blocks examined to place siblings
+      size_t trial_exhausted;   // Open blocks closed after MAX_TRIAL failures
+      size_t add_block;         // blocks appended
+      size_t realloc;           // arrays grown
+      size_t realloc_bytes;     // bytes in arrays when grown; copied at worst
+      size_t tail_append;       // regions appended to _tail
+      size_t tail_append_bytes;
+      size_t transfer[3][3];    // blocks moved from list i to list j (block_list)
+      size_t relocation_hist[NUM_RELOCATION_BINS]; // updates by nodes moved: 0, 1, 2-3, 4-7, ..
     };
     struct ninfo {  // x1.5 update speed; +.25 % memory (8n -> 10n)
       uchar  sibling;   // right sibling (= 0 if not exist)
       uchar  child;     // first child
       ninfo () : sibling (0), child (0) {}
     };
+    struct node : node_info <ninfo, FUSED> {
+      union { index_type base; slot_type value; }; // negative means prev empty index
+      index_type check;                            // negative means next empty index
+      node (const index_type base_ = 0, const index_type check_ = 0)
+        : node_info <ninfo, FUSED> (), base (base_), check (check_) {}
+    };
     struct block { // a block w/ 256 elements
-      int   prev;   // prev block; 3 bytes
-      int   next;   // next block; 3 bytes
-      short num;    // # empty elements; 0 - 256
-      short reject; // minimum # branching failed to locate; soft limit
-      int   trial;  // # trial
-      int   ehead;  // first empty item
+      index_type prev;   // prev block; 3 bytes
+      index_type next;   // next block; 3 bytes
+      short      num;    // # empty elements; 0 - 256
+      short      reject; // minimum # branching failed to locate; soft limit
+      int        trial;  // # trial
+      index_type ehead;  // first empty item
       block () : prev (0), next (0), num (256), reject (257), trial (0), ehead (0) {}
     };
-    da () : tracking_node (), _array (0), _tail (0), _tail0 (0), _ninfo (0), _block (0), _bheadF (0), _bheadC (0), _bheadO (0), _capacity (0), _size (0), _quota (0), _quota0 (0), _no_delete (false), _reject () {
-      STATIC_ASSERT(sizeof (value_type) <= sizeof (int),
+    STATIC_ASSERT(static_cast <index_type> (-1) < 0 && sizeof (index_type) >= sizeof (int) &&
+                  sizeof (index_type) <= sizeof (npos_t),
+                  index_type_must_be_a_signed_integer_of_32_or_64_bits);
+    struct leaf_block { // nodes with suffixes on a shared _tail among 256 nodes
+      index_type rank;    // # such nodes in the preceding blocks
+      unsigned   bits[8]; // whether each node has a suffix
+    };
+    // file format; a header followed by aligned sections.  version 2 adds
+    // SEC_LEAF, which only a trie with a shared _tail has; any other trie
+    // is saved as version 1
+    enum { FILE_VERSION = 2 };
+    enum save_flag { SAVE_RAW        = 1,   // old format; _tail + _array (+ .sbl)
+                     SAVE_RESTORE    = 2,   // add _ninfo, _block and bheads
+                     SAVE_PAGE_ALIGN = 4 }; // align sections to 4KiB pages
+    enum section_id { SEC_TAIL, SEC_ARRAY, SEC_NINFO, SEC_BLOCK, SEC_BHEAD, SEC_LEAF, NUM_SECTIONS };
+    struct section {
+      npos_t offset; // from the head of the header
+      npos_t size;   // in bytes; 0 if absent
+    };
+    struct file_header {
+      char    magic[8];
+      int     version;
+      int     header_size;
+      int     ordered;
+      int     value_size;  // sizeof (value_type)
+      int     node_size;   // sizeof (node)
+      int     no_value;
+      int     no_path;
+      int     num_sections;
+      section sec[NUM_SECTIONS];
+    };
+    da () : tracking_node (), _array (0), _tail (0), _tail0 (0), _ninfo (0), _block (0), _leaf (0), _bheadF (0), _bheadC (0), _bheadO (0), _capacity (0), _size (0), _quota (0), _quota0 (0), _no_delete (false), _mapped (0), _mapped_size (0), _num_keys (0), _num_nodes (0), _num_values (0), _revision (0), _garbage (0), _free (), _reject () {
+      STATIC_ASSERT(sizeof (value_type) <= 4 * sizeof (int),
                     value_type_is_not_supported___maintain_a_value_array_by_yourself_and_store_its_index_to_trie
                     );
+      reset_stats ();
       _initialize ();
     }
     ~da () { clear (false); }
@@ -82,43 +698,66 @@ namespace cedar {
     size_t length     () const { return static_cast <size_t> (*_length); }
     size_t total_size () const { return sizeof (node) * _size; }
     size_t unit_size  () const { return sizeof (node); }
-    size_t nonzero_size () const {
-      size_t i = 0;
-      for (int to = 0; to < _size; ++to)
-        if (_array[to].check >= 0) ++i;
-      return i;
-    }
+    // maintained by update () and erase (); recounted once on open ()
+    size_t nonzero_size () const { return static_cast <size_t> (_num_nodes); }
+    // bytes of suffixes and their values; with a shared _tail, including
+    // the region of values and ranks
     size_t nonzero_length () const {
-      size_t i (0), j (0);
-      for (int to = 0; to < _size; ++to) {
-        const node& n = _array[to];
-        if (n.check >= 0 && _array[n.check].base != to && n.base < 0)
-          { ++j; for (const char* p = &_tail[-n.base]; *p; ++p) ++i; }
-      }
-      return i + j * (1 + sizeof (value_type));
-    }
-    size_t num_keys () const {
-      size_t i = 0;
-      for (int to = 0; to < _size; ++to) {
-        const node& n = _array[to];
-        if (n.check >= 0 && (_array[n.check].base == to || n.base < 0)) ++i;
-      }
-      return i;
+      return static_cast <size_t> (*_length - _garbage - _num_values * static_cast <index_type> (sizeof (value_type)))
+        - sizeof (index_type) + _leaf_bytes ();
     }
+    size_t num_keys () const { return static_cast <size_t> (_num_keys); }
+    // bumped by every call that may change keys, values or where they are;
+    // an index built over the trie is stale once this differs
+    size_t revision () const { return _revision; }
     // interfance
     template <typename T>
     T exactMatchSearch (const char* key) const
     { return exactMatchSearch <T> (key, std::strlen (key)); }
     template <typename T>
     T exactMatchSearch (const char* key, size_t len, npos_t from = 0) const {
-      union { int i; value_type x; } b;
       size_t pos = 0;
-      b.i = _find (key, from, pos, len);
-      if (b.i == CEDAR_NO_PATH) b.i = CEDAR_NO_VALUE;
+      index_type i = _find (key, from, pos, len);
+      if (i == CEDAR_NO_PATH) i = CEDAR_NO_VALUE;
       T result;
-      _set_result (&result, b.x, len, from);
+      _set_result (&result, _value_of (i), len, from);
       return result;
     }
+    // look up n keys at once; NUM_STREAMS lookups advance in turn, each
+    // prefetching its next node so that cache misses overlap
+    template <typename T>
+    void exactMatchSearch (const char** key, const size_t* len, T* result, const size_t n) const {
+      stream s[NUM_STREAMS];
+      size_t m (0), i (0);
+      for (; m < NUM_STREAMS && i < n; ++m, ++i)
+        _start_stream (s[m], key[i], len ? len[i] : std::strlen (key[i]), i);
+      while (m)
+        for (size_t k = 0; k < m; ) {
+          stream& t = s[k];
+          index_type r;
+          if (t.tail) {
+            r = _find (t.key, t.from, t.pos, t.len);
+          } else {
+            const node& n_ = _array[t.to];
+            if (n_.check != static_cast <index_type> (t.from))
+              r = CEDAR_NO_PATH;
+            else if (t.pos > t.len)
+              r = _value_id (n_);
+            else { // move on
+              t.from = t.to;
+              _advance_stream (t, n_.base);
+              ++k;
+              continue;
+            }
+          }
+          if (r == CEDAR_NO_PATH) r = CEDAR_NO_VALUE;
+          _set_result (&result[t.id], _value_of (r), t.len, t.from);
+          if (i < n)
+            _start_stream (t, key[i], len ? len[i] : std::strlen (key[i]), i), ++i, ++k;
+          else
+            t = s[--m];
+        }
+    }
     template <typename T>
     size_t commonPrefixSearch (const char* key, T* result, size_t result_len) const
     { return commonPrefixSearch (key, result, result_len, std::strlen (key)); }
@@ -126,15 +765,90 @@ namespace cedar {
     size_t commonPrefixSearch (const char* key, T* result, size_t result_len, size_t len, npos_t from = 0) const {
       size_t num = 0;
       for (size_t pos = 0; pos < len; ) {
-        union { int i; value_type x; } b;
-        b.i = _find (key, from, pos, pos + 1);
-        if (b.i == CEDAR_NO_VALUE) continue;
-        if (b.i == CEDAR_NO_PATH)  return num;
-        if (num < result_len) _set_result (&result[num], b.x, pos, from);
+        const index_type i = _find (key, from, pos, pos + 1);
+        if (i == CEDAR_NO_VALUE) continue;
+        if (i == CEDAR_NO_PATH)  return num;
+        if (num < result_len) _set_result (&result[num], _value_of (i), pos, from);
         ++num;
       }
       return num;
     }
+    // the longest key that prefixes key, in a single walk that keeps the
+    // last terminal passed; CEDAR_NO_VALUE and length 0 if none
+    template <typename T>
+    T longestPrefixSearch (const char* key) const
+    { return longestPrefixSearch <T> (key, std::strlen (key)); }
+    template <typename T>
+    T longestPrefixSearch (const char* key, size_t len, npos_t from = 0) const {
+      index_type i = CEDAR_NO_VALUE;
+      size_t l (0), pos (0);
+      npos_t to = from;
+      for (const uchar* const key_ = reinterpret_cast <const uchar*> (key); ; ++pos) {
+        npos_t offset = _tail_of (from);
+        if (offset || _array[from].base < 0) { // match the rest on _tail
+          if (! offset) offset = static_cast <npos_t> (-_array[from].base);
+          const char* const tail = &_tail[offset] - pos;
+          const size_t end = _match_tail (key, tail, pos, len);
+          if (! tail[end]) {
+            to = from, l = end;
+            if (end > pos) _set_tail (to, offset + (end - pos));
+            i = _value_id (&tail[end + 1], _node_of (from));
+          }
+          break;
+        }
+        const index_type base = _array[from].base;
+        const node& n = _array[base ^ 0];
+        if (n.check == static_cast <index_type> (from)) i = _value_id (n), l = pos, to = from;
+        if (pos == len) break;
+        const npos_t next = static_cast <npos_t> (base ^ key_[pos]);
+        if (_array[next].check != static_cast <index_type> (from)) break;
+        from = next;
+      }
+      T result;
+      _set_result (&result, _value_of (i), l, to);
+      return result;
+    }
+    // every key found at every position of key, as commonPrefixSearch from
+    // each position in turn but with no keys restored; store up to
+    // result_len matches into begin[], length[] and value[] by begin and
+    // then length, and return the number of matches
+    size_t lattice (const char* key, size_t* begin, size_t* length, value_type* value, size_t result_len) const
+    { return lattice (key, begin, length, value, result_len, std::strlen (key)); }
+    size_t lattice (const char* key, size_t* begin, size_t* length, value_type* value, size_t result_len, size_t len) const {
+      const uchar* const key_ = reinterpret_cast <const uchar*> (key);
+      size_t num (0), end (0);
+      for (size_t b = 0; b < len; ++b) {
+        if (b >= end) { // keys have no '\0'; search up to the next one
+          const void* const z = std::memchr (&key[b], 0, len - b);
+          end = z ? static_cast <size_t> (static_cast <const char*> (z) - key) : len;
+        }
+        npos_t from = 0;
+        for (size_t pos = b; ; ++pos) {
+          const index_type base = _array[from].base;
+          if (base < 0) { // match the rest on _tail
+            const char* const tail = &_tail[-base] - pos;
+            const size_t e = _match_tail (key, tail, pos, end);
+            if (! tail[e]) {
+              if (num < result_len)
+                begin[num] = b, length[num] = e - b, value[num] = _value_of (_value_id (&tail[e + 1], from));
+              ++num;
+            }
+            break;
+          }
+          const node& n = _array[base ^ 0];
+          if (pos > b && n.check == static_cast <index_type> (from)) {
+            if (num < result_len)
+              begin[num] = b, length[num] = pos - b, value[num] = _value_of (_value_id (n));
+            ++num;
+          }
+          if (pos == end) break;
+          const npos_t next = static_cast <npos_t> (base ^ key_[pos]);
+          if (_array[next].check != static_cast <index_type> (from)) break;
+          from = next;
+        }
+      }
+      return num;
+    }
     // predict key from double array
     template <typename T>
     size_t commonPrefixPredict (const char* key, T* result, size_t result_len)
@@ -143,37 +857,74 @@ namespace cedar {
     size_t commonPrefixPredict (const char* key, T* result, size_t result_len, size_t len, npos_t from = 0) {
       size_t num (0), pos (0), p (0);
       if (_find (key, from, pos, len) == CEDAR_NO_PATH) return 0;
-      union { int i; value_type x; } b;
       const npos_t root = from;
-      for (b.i = begin (from, p); b.i != CEDAR_NO_PATH; b.i = next (from, p, root)) {
+      for (index_type i = begin (from, p); i != CEDAR_NO_PATH; i = next (from, p, root)) {
         if (num < result_len)
-          _set_result (&result[num], b.x, p, from);
+          _set_result (&result[num], _value_of (i), p, from);
         ++num;
       }
       return num;
     }
+    // keys within max_distance edits (insertions, deletions and substitutions
+    // of bytes) of key, in the order of begin () and next (); distance[]
+    // receives the edit distance of each key stored if given
+    template <typename T>
+    size_t fuzzySearch (const char* key, T* result, size_t result_len, size_t max_distance)
+    { return fuzzySearch (key, result, result_len, std::strlen (key), max_distance); }
+    template <typename T>
+    size_t fuzzySearch (const char* key, T* result, size_t result_len, size_t len, size_t max_distance, size_t* distance = 0) {
+      if (! _has_ninfo ()) _restore_ninfo ();
+      // a row of the edit distance table per depth; the minimum of a row at
+      // depth d is >= d - len, so no walk goes below len + max_distance + 1
+      size_t rows = len + 2 + std::min (max_distance, static_cast <size_t> (62));
+      size_t* row = static_cast <size_t*> (std::malloc (sizeof (size_t) * (len + 1) * rows));
+      if (! row) _err (__FILE__, __LINE__, "memory allocation failed\n");
+      for (size_t i = 0; i <= len; ++i) row[i] = i;
+      size_t num = 0;
+      _fuzzy (key, len, max_distance, 0, 0, row, rows, result, distance, result_len, num);
+      std::free (row);
+      return num;
+    }
+    // keys a dfa accepts, in the order of begin () and next (); walk only
+    // children whose labels the dfa takes, probing them by base if a state
+    // takes a few bytes, or following siblings otherwise
+    template <typename T>
+    size_t patternSearch (const dfa& d, T* result, size_t result_len) {
+      collector <T> f = { this, result, result_len, 0 };
+      patternSearch (d, f);
+      return f.num;
+    }
+    // call f (value, length, id) for each key d accepts
+    template <typename F>
+    void patternSearch (const dfa& d, F& f) {
+      if (! d.num_states ()) return;
+      bool siblings = false;
+      for (int s = 0; s < d.num_states (); ++s)
+        if (d.num_labels (s) > MAX_PROBE) siblings = true;
+      if (siblings && ! _has_ninfo ()) _restore_ninfo ();
+      _pattern (d, f, 0, 0, 0);
+    }
     void suffix (char* key, size_t len, npos_t to) const {
       key[len] = '\0';
-      if (const int offset = static_cast <int> (to >> 32)) {
-        to &= TAIL_OFFSET_MASK;
+      if (const size_t offset = _tail_of (to)) {
+        to = _node_of (to);
         size_t len_tail = std::strlen (&_tail[-_array[to].base]);
         if (len > len_tail) len -= len_tail; else len_tail = len, len = 0;
-        std::memcpy (&key[len], &_tail[static_cast <size_t> (offset) - len_tail], len_tail);
+        std::memcpy (&key[len], &_tail[offset - len_tail], len_tail);
       }
       while (len--) {
-        const int from = _array[to].check;
-        key[len] = static_cast <char> (_array[from].base ^ static_cast <int> (to));
+        const index_type from = _array[to].check;
+        key[len] = static_cast <char> (_array[from].base ^ static_cast <index_type> (to));
         to = static_cast <npos_t> (from);
       }
     }
     value_type traverse (const char* key, npos_t& from, size_t& pos) const
     { return traverse (key, from, pos, std::strlen (key)); }
-    value_type traverse (const char* key, npos_t& from, size_t& pos, size_t len) const {
-      union { int i; value_type x; } b;
-      b.i = _find (key, from, pos, len);
-      return b.x;
-    }
-    struct empty_callback { void operator () (const int, const int) {} }; // dummy empty function
+    value_type traverse (const char* key, npos_t& from, size_t& pos, size_t len) const
+    { return _value_of (_find (key, from, pos, len)); }
+    // the value of an id returned by begin () and next ()
+    value_type value (const index_type id) const { return _value_of (id); }
+    struct empty_callback { void operator () (const index_type, const index_type) {} }; // dummy empty function
     value_type& update (const char* key)
     { return update (key, std::strlen (key)); }
     value_type& update (const char* key, size_t len, value_type val = value_type (0))
@@ -185,43 +936,44 @@ namespace cedar {
       if (! len && ! from)
         //_err (__FILE__, __LINE__, "failed to insert zero-length key\n");
         throw std::runtime_error("failed to insert zero-length key\n");
-#ifndef USE_FAST_LOAD
-      if (! _ninfo || ! _block) restore ();
-#endif
-      npos_t offset = from >> 32;
+      if (! _has_ninfo () || ! _block || _no_delete) restore ();
+      ++_revision; // the value may change through the reference returned
+      CEDAR_STAT (const relocation_scope scope (_stats));
+      npos_t offset = _tail_of (from);
       if (! offset) { // node on trie
         for (const uchar* const key_ = reinterpret_cast <const uchar*> (key);
              _array[from].base >= 0; ++pos) {
-          if (pos == len)
-            { const int to = _follow (from, 0, cf); return _array[to].value += val; }
+          if (pos == len) {
+            if (_array[_array[from].base ^ 0].check != static_cast <index_type> (from)) ++_num_keys;
+            const index_type to = _follow (from, 0, cf);
+            return _ref (_array[to].value) += val;
+          }
           from = static_cast <size_t> (_follow (from, key_[pos], cf));
         }
         offset = static_cast <npos_t> (-_array[from].base);
       }
-      if (offset >= sizeof (int)) { // go to _tail
+      if (offset >= sizeof (index_type)) { // go to _tail
         const size_t pos_orig = pos;
         char* const tail = &_tail[offset] - pos;
-        while (pos < len && key[pos] == tail[pos]) ++pos;
+        pos = _match_tail (key, tail, pos, len);
         //
         if (pos == len && tail[pos] == '\0') { // found exact key
-          if (const npos_t moved = pos - pos_orig) { // search end on tail
-            from &= TAIL_OFFSET_MASK;
-            from |= (offset + moved) << 32;
-          }
+          if (const npos_t moved = pos - pos_orig) // search end on tail
+            _set_tail (from, offset + moved);
           return *reinterpret_cast <value_type*> (&tail[len + 1]) += val;
         }
         // otherwise, insert the common prefix in tail if any
-        if (from >> 32) {
-          from &= TAIL_OFFSET_MASK; // reset to update tail offset
-          for (npos_t offset_ = static_cast <npos_t> (-_array[from].base);
-               offset_ < offset; ) {
+        if (from >> NODE_BITS) {
+          from = _node_of (from); // reset to update tail offset
+          const npos_t head = static_cast <npos_t> (-_array[from].base);
+          for (npos_t offset_ = head; offset_ < offset; ) {
             from = static_cast <size_t>
                    (_follow (from, static_cast <uchar> (_tail[offset_]), cf));
             ++offset_;
             // this shows intricacy in debugging updatable double array trie
             if (NUM_TRACKING_NODES) // keep the traversed node (on tail) updated
               for (size_t j = 0; tracking_node[j] != 0; ++j)
-                if (tracking_node[j] >> 32 == offset_)
+                if (tracking_node[j] >> NODE_BITS == (NODE_BITS == 32 ? offset_ : offset_ - head + 1))
                   tracking_node[j] = static_cast <npos_t> (from);
           }
         }
@@ -230,144 +982,252 @@ namespace cedar {
                  (_follow (from, static_cast <uchar> (key[pos_]), cf));
         npos_t moved = pos - pos_orig;
         if (tail[pos]) { // remember to move offset to existing tail
-          const int to_ = _follow (from, static_cast <uchar> (tail[pos]), cf);
-          _array[to_].base = - static_cast <int> (offset + ++moved);
+          const index_type to_ = _follow (from, static_cast <uchar> (tail[pos]), cf);
+          _array[to_].base = - static_cast <index_type> (offset + ++moved);
           moved -= 1 + sizeof (value_type); // keep record
         }
-        moved += offset;
-        for (npos_t i = offset; i <= moved; i += 1 + sizeof (value_type)) {
-          if (_quota0 == ++*_length0) {
-#ifdef USE_EXACT_FIT
-            _quota0 += *_length0 >= MAX_ALLOC_SIZE ? MAX_ALLOC_SIZE : *_length0;
-#else
-            _quota0 += _quota0;
-#endif
-            _realloc_array (_tail0, _quota0, *_length0);
-          }
-          _tail0[*_length0] = static_cast <int> (i);
-        }
-        if (pos == len || tail[pos] == '\0') {
-          const int to = _follow (from, 0, cf);
-          if (pos == len) return _array[to].value += val; // set value on tail
-          _array[to].value += *reinterpret_cast <value_type*> (&tail[pos + 1]);
-        }
+        const index_type dead = static_cast <index_type> (moved + 1 + sizeof (value_type));
+        if (pos == len || tail[pos] == '\0') { // read before tail may move
+          value_type v = val;
+          if (pos < len) std::memcpy (&v, &tail[pos + 1], sizeof (value_type));
+          _free_tail (static_cast <index_type> (offset), dead);
+          const index_type to = _follow (from, 0, cf);
+          value_type& r = _ref (_array[to].value) += v;
+          if (pos == len) return ++_num_keys, r; // set value on tail
+        } else
+          _free_tail (static_cast <index_type> (offset), dead);
         from = static_cast <size_t> (_follow (from, static_cast <uchar> (key[pos]), cf));
         ++pos;
       }
-      const int needed = static_cast <int> (len - pos + 1 + sizeof (value_type));
+      const index_type needed = static_cast <index_type> (len - pos + 1 + sizeof (value_type));
+      ++_num_keys;
       if (pos == len && *_length0) { // reuse
-        const int offset0 = _tail0[*_length0];
+        const index_type offset0 = _tail0[*_length0];
         _tail[offset0] = '\0';
         _array[from].base = -offset0;
         --*_length0;
+        _garbage -= needed;
         return *reinterpret_cast <value_type*> (&_tail[offset0 + 1]) = val;
       }
-      if (_quota < *_length + needed) {
-#ifdef USE_EXACT_FIT
-        _quota += needed > *_length || needed > MAX_ALLOC_SIZE ? needed :
-                  (*_length >= MAX_ALLOC_SIZE ? MAX_ALLOC_SIZE : *_length);
-#else
-        _quota += _quota >= needed ? _quota : needed;
-#endif
-        _realloc_array (_tail, _quota, *_length);
-      }
-      _array[from].base = -*_length;
+      const index_type offset_ = _take_tail (needed);
+      _array[from].base = -offset_;
       const size_t pos_orig = pos;
-      char* const tail = &_tail[*_length] - pos;
+      char* const tail = &_tail[offset_] - pos;
       if (pos < len) {
         do tail[pos] = key[pos]; while (++pos < len);
-        from |= (static_cast <npos_t> (*_length) + (len - pos_orig)) << 32;
+        _set_tail (from, static_cast <size_t> (offset_) + (len - pos_orig));
       }
-      *_length += needed;
-      return *reinterpret_cast <value_type*> (&tail[len + 1]) += val;
+      tail[len] = '\0';
+      return *reinterpret_cast <value_type*> (&tail[len + 1]) = val;
     }
     // easy-going erase () without compression
     int erase (const char* key) { return erase (key, std::strlen (key)); }
     int erase (const char* key, size_t len, npos_t from = 0) {
+      if (! _has_ninfo () || ! _block || _no_delete) restore ();
       size_t pos = 0;
-      const int i = _find (key, from, pos, len);
+      const index_type i = _find (key, from, pos, len);
       if (i == CEDAR_NO_PATH || i == CEDAR_NO_VALUE) return -1;
-      if (from >> 32) from &= TAIL_OFFSET_MASK; // leave tail as is
+      --_num_keys, ++_revision;
+      from = _node_of (from);
       bool flag = _array[from].base < 0; // have sibling
-      int e = flag ? static_cast <int> (from) : _array[from].base ^ 0;
+      if (flag) { // release the suffix for reuse
+        const index_type offset = -_array[from].base;
+        _free_tail (offset, static_cast <index_type> (std::strlen (&_tail[offset]) + 1 + sizeof (value_type)));
+      }
+      index_type e = flag ? static_cast <index_type> (from) : _array[from].base ^ 0;
+      if (! flag) _free_value (_array[e].base);
       from  = _array[e].check;
       do {
         const node& n = _array[from];
-        flag = _ninfo[n.base ^ _ninfo[from].child].sibling;
+        flag = _info (n.base ^ _info (from).child).sibling;
         if (flag) _pop_sibling (from, n.base, static_cast <uchar> (n.base ^ e));
         _push_enode (e);
-        e = static_cast <int> (from);
+        e = static_cast <index_type> (from);
         from = static_cast <size_t> (_array[from].check);
       } while (! flag);
       return 0;
     }
-    int build (size_t num, const char** key, const size_t* len = 0, const value_type* val = 0) {
-      for (size_t i = 0; i < num; ++i)
-        update (key[i], len ? len[i] : std::strlen (key[i]), val ? val[i] : value_type (i));
+    // build from keys; sorted keys are bulk-loaded into an empty trie,
+    // using up to num_threads threads for subtries split by the first byte
+    int build (size_t num, const char** key, const size_t* len = 0, const value_type* val = 0,
+               const size_t num_threads = 1) {
+      size_t* len_ = 0;
+      if (! len) { // compute key lengths once
+        len_ = static_cast <size_t*> (std::malloc (sizeof (size_t) * (num + 1)));
+        if (! len_) _err (__FILE__, __LINE__, "memory allocation failed\n");
+        for (size_t i = 0; i < num; ++i) len_[i] = std::strlen (key[i]);
+        len = len_;
+      }
+      if (! _has_ninfo () || ! _block || _no_delete) restore ();
+      ++_revision;
+      if (num && ! _info (0).sibling && _sorted (num, key, len)) {
+#if __cplusplus >= 201103L
+        if (num_threads > 1)
+          _build_parallel (num, key, len, val, num_threads);
+        else
+#endif
+          _build (0, 0, num, 0, key, len, val);
+      } else
+        for (size_t i = 0; i < num; ++i)
+          update (key[i], len[i], val ? val[i] : value_type (i));
+      std::free (len_);
       return 0;
     }
     template <typename T>
     void dump (T* result, const size_t result_len) {
-      union { int i; value_type x; } b;
       size_t num (0), p (0);
       npos_t from = 0;
-      for (b.i = begin (from, p); b.i != CEDAR_NO_PATH; b.i = next (from, p))
+      for (index_type i = begin (from, p); i != CEDAR_NO_PATH; i = next (from, p))
         if (num < result_len)
-          _set_result (&result[num++], b.x, p, from);
+          _set_result (&result[num++], _value_of (i), p, from);
         else
           _err (__FILE__, __LINE__, "dump() needs array of length = num_keys()\n");
     }
-    void shrink_tail () {
-      union { char* tail; int* length; } t;
-      const size_t length_
-        = static_cast <size_t> (*_length)
-        - static_cast <size_t> (*_length0) * (1 + sizeof (value_type));
-      t.tail = static_cast <char*> (std::malloc (length_));
-      if (! t.tail) _err (__FILE__, __LINE__, "memory allocation failed\n");
-      *t.length = static_cast <int> (sizeof (int));
-      for (int to = 0; to < _size; ++to) {
-        node& n = _array[to];
-        if (n.check >= 0 && _array[n.check].base != to && n.base < 0) {
-          char* const tail (&t.tail[*t.length]), * const tail_ (&_tail[-n.base]);
-          n.base = - *t.length;
-          int i = 0; do tail[i] = tail_[i]; while (tail[i++]);
-          *reinterpret_cast <value_type*> (&tail[i])
-            = *reinterpret_cast <const value_type*> (&tail_[i]);
-          *t.length += i + static_cast <int> (sizeof (value_type));
+    // rebuild the trie densely after erases; returns the bytes reclaimed
+    size_t compact () {
+      da t;
+      const size_t reclaimed = compact (t);
+      _swap (t);
+      ++_revision;
+      return reclaimed;
+    }
+    // rebuild into t, leaving this trie as is
+    size_t compact (da& t) {
+      size_t num (0), used (0), quota_k (0), quota_b (256);
+      size_t* offset = 0; // of keys in buf
+      size_t* len    = 0;
+      char*   buf    = static_cast <char*> (std::malloc (quota_b));
+      value_type* val = 0;
+      if (! buf) _err (__FILE__, __LINE__, "memory allocation failed\n");
+      size_t p = 0;
+      npos_t from = 0;
+      for (index_type i = begin (from, p); i != CEDAR_NO_PATH; i = next (from, p)) {
+        if (num == quota_k) {
+          quota_k = quota_k ? quota_k * 2 : 256;
+          offset = static_cast <size_t*> (std::realloc (offset, sizeof (size_t) * quota_k));
+          len    = static_cast <size_t*> (std::realloc (len, sizeof (size_t) * quota_k));
+          val    = static_cast <value_type*> (std::realloc (val, sizeof (value_type) * quota_k));
+          if (! offset || ! len || ! val) _err (__FILE__, __LINE__, "memory allocation failed\n");
+        }
+        while (quota_b < used + p + 1) {
+          quota_b *= 2;
+          if (! (buf = static_cast <char*> (std::realloc (buf, quota_b))))
+            _err (__FILE__, __LINE__, "memory allocation failed\n");
         }
+        suffix (&buf[used], p, from);
+        offset[num] = used, len[num] = p, val[num] = _value_of (i);
+        used += p + 1, ++num;
       }
-      std::free (_tail);
-      _tail = t.tail;
-      _realloc_array (_tail,  *_length,  *_length);
+      const char** key = static_cast <const char**> (std::malloc (sizeof (char*) * (num + 1)));
+      if (! key) _err (__FILE__, __LINE__, "memory allocation failed\n");
+      for (size_t i = 0; i < num; ++i) key[i] = &buf[offset[i]];
+      t.clear ();
+      t.build (num, key, len, val);
+      t._shrink ();
+      std::free (key), std::free (offset), std::free (len), std::free (val), std::free (buf);
+      const size_t before (_footprint ()), after (t._footprint ());
+      return before > after ? before - after : 0;
+    }
+    // drop what only updates need (_ninfo, _block, _tail0, spare capacity
+    // and dead tail bytes) from a trie to be searched only, after packing
+    // its nodes with compact () if rebuild; returns the bytes released.
+    // queries, save () and open_mmap () work as before (begin () rebuilds
+    // _ninfo on first use), and the next update restores the rest.  a key
+    // that no other key extends keeps its value after its suffix on _tail
+    // and has no node of its own, so values are already in place as with
+    // USE_REDUCED_TRIE of cedar.h.  if share, each distinct suffix is kept
+    // once and a suffix of another points into it, while the values move
+    // to a region indexed by the rank of the node among nodes with suffixes;
+    // this pays for keys with common endings such as URLs and paths with
+    // an extra cache miss or two in a search that ends on _tail
+    size_t freeze (const bool rebuild = true, const bool share = false) {
+      if (_no_delete) return 0; // static already
+      ++_revision;
+      const size_t before = _footprint ();
+      if (rebuild) compact ();
+      shrink_tail ();
+      index_type last = 0; // used node; base ^ label never leaves its block
+      for (index_type i = _size - 1; i > 0 && ! last; --i)
+        if (_array[i].check >= 0) last = i;
+      _capacity = _size = (last | 255) + 1;
+      _realloc_array (_array, _size, _size);
+      _free_array (_ninfo);
+      _free_array (_block);
+      _free_array (_tail0);
+      _bheadF = _bheadC = _bheadO = 0;
+      if (share && ! _leaf) _share_tail ();
       _quota  = *_length;
-      _realloc_array (_tail0, 1);
-      _quota0 = 1;
+      _quota0 = 0;
+      const size_t after = _footprint ();
+      return before > after ? before - after : 0;
+    }
+    // dead bytes in _tail, reused by new suffixes or reclaimed by shrink_tail ()
+    size_t garbage () const { return static_cast <size_t> (_garbage); }
+    stats_type stats () const {
+#ifdef USE_STATS
+      return _stats;
+#else
+      return stats_type ();
+#endif
+    }
+    void reset_stats () { CEDAR_STAT (_stats = stats_type ()); }
+    // reclaim dead tail bytes if they exceed ratio of _tail; this moves
+    // suffixes and invalidates cursors on _tail held by callers
+    bool collect_tail (const double ratio = 0.5) {
+      if (_garbage <= ratio * *_length) return false;
+      shrink_tail ();
+      return true;
     }
+    // a shared _tail has no dead bytes and is left as is
+    void shrink_tail () { if (! _leaf) _copy_tail (); }
     int save (const char* fn, const char* mode, const bool shrink) {
       if (shrink) shrink_tail ();
       return save (fn, mode);
     }
     int save (const char* fn, const char* mode = "wb") const {
-      // _test ();
-      FILE* fp = std::fopen (fn, mode);
-      if (! fp) return -1;
-      std::fwrite (_tail,  sizeof (char), static_cast <size_t> (*_length), fp);
-      std::fwrite (_array, sizeof (node), static_cast <size_t> (_size), fp);
-      std::fclose (fp);
 #ifdef USE_FAST_LOAD
-      const char* const info
-        = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".sbl");
-      fp = std::fopen (info, mode);
-      delete [] info; // resolve memory leak
-      if (! fp) return -1;
-      std::fwrite (&_bheadF, sizeof (int), 1, fp);
-      std::fwrite (&_bheadC, sizeof (int), 1, fp);
-      std::fwrite (&_bheadO, sizeof (int), 1, fp);
-      std::fwrite (_ninfo, sizeof (ninfo), static_cast <size_t> (_size), fp);
-      std::fwrite (_block, sizeof (block), static_cast <size_t> (_size >> 8), fp);
-      std::fclose (fp);
+      return save (fn, SAVE_RESTORE, mode);
+#else
+      return save (fn, 0, mode);
 #endif
-      return 0;
+    }
+    int save (const char* fn, const int flags, const char* mode = "wb") const {
+      if (flags & SAVE_RAW) return _leaf ? -1 : _save_raw (fn, mode);
+      const npos_t align = flags & SAVE_PAGE_ALIGN ? 4096 : 8;
+      const bool restore_ = (flags & SAVE_RESTORE) && _has_ninfo () && _block && ! _no_delete;
+      file_header h;
+      _init_header (h, _leaf);
+      const npos_t size[NUM_SECTIONS] = {
+        static_cast <npos_t> (*_length),
+        sizeof (node) * static_cast <npos_t> (_size),
+        restore_ && ! FUSED ? sizeof (ninfo) * static_cast <npos_t> (_size) : 0,
+        restore_ ? sizeof (block) * static_cast <npos_t> (_size >> 8) : 0,
+        restore_ ? sizeof (index_type) * 3 : 0,
+        _leaf_bytes () };
+      const index_type bhead[3] = { _bheadF, _bheadC, _bheadO };
+      const void* const data[NUM_SECTIONS] = { _tail, _array, _ninfo, _block, bhead, _leaf };
+      npos_t offset = sizeof (file_header);
+      for (int i = 0; i < NUM_SECTIONS; ++i) {
+        if (! size[i]) continue;
+        offset = (offset + align - 1) / align * align;
+        h.sec[i].offset = offset;
+        h.sec[i].size   = size[i];
+        offset += size[i];
+      }
+      FILE* fp = std::fopen (fn, mode);
+      if (! fp) return -1;
+      static const char pad[4096] = {};
+      bool ok = std::fwrite (&h, sizeof (file_header), 1, fp) == 1;
+      offset = sizeof (file_header);
+      for (int i = 0; ok && i < NUM_SECTIONS; ++i) {
+        if (! size[i]) continue;
+        const size_t pad_ = static_cast <size_t> (h.sec[i].offset - offset);
+        ok = std::fwrite (pad, 1, pad_, fp) == pad_ &&
+             std::fwrite (data[i], 1, static_cast <size_t> (size[i]), fp) == size[i];
+        offset = h.sec[i].offset + size[i];
+      }
+      if (std::fclose (fp) != 0) ok = false;
+      return ok ? 0 : -1;
     }
     int open (const char* fn, const char* mode = "rb",
               const size_t offset = 0, size_t size_ = 0) {
@@ -381,114 +1241,124 @@ namespace cedar {
       }
       if (size_ <= offset) return -1;
       if (std::fseek (fp, static_cast <long> (offset), SEEK_SET) != 0) return -1;
-      int len = 0;
-      if (std::fread (&len, sizeof (int), 1, fp) != 1) return -1;
-      const size_t length_ = static_cast <size_t> (len);
-      if (size_ <= offset + length_) return -1;
-      // set array
+      file_header h;
+      if (size_ - offset >= sizeof (file_header) &&
+          std::fread (&h, sizeof (file_header), 1, fp) == 1 && _is_header (h)) {
+        const int ret = _open_sections (fp, h, offset, size_ - offset);
+        std::fclose (fp);
+        return ret;
+      }
+      return _open_raw (fp, fn, mode, offset, size_);
+    }
+#ifndef _WIN32
+    // map a saved trie read-only; pages are shared through the page cache,
+    // and the trie is copied to private memory on the first update ()
+    int open_mmap (const char* fn, const size_t offset = 0, size_t size_ = 0) {
+      const int fd = ::open (fn, O_RDONLY);
+      if (fd < 0) return -1;
+      struct stat st;
+      if (::fstat (fd, &st) != 0) { ::close (fd); return -1; }
+      if (! size_) size_ = static_cast <size_t> (st.st_size);
+      if (size_ <= offset + sizeof (index_type) || size_ > static_cast <size_t> (st.st_size))
+        { ::close (fd); return -1; }
+      void* const p = ::mmap (0, size_, PROT_READ, MAP_SHARED, fd, 0);
+      ::close (fd);
+      if (p == MAP_FAILED) return -1;
+      if (offset % sizeof (index_type)) // misaligned array; fall back to copy
+        { ::munmap (p, size_); return open (fn, "rb", offset, size_); }
+      char* const head = static_cast <char*> (p) + offset;
       clear (false);
-      size_ = (size_ - offset - length_) / sizeof (node);
-      _array = static_cast <node*>  (std::malloc (sizeof (node)  * size_));
-      _tail  = static_cast <char*>  (std::malloc (length_));
-      _tail0 = static_cast <int*>   (std::malloc (sizeof (int)));
-#ifdef USE_FAST_LOAD
-      _ninfo = static_cast <ninfo*> (std::malloc (sizeof (ninfo) * size_));
-      _block = static_cast <block*> (std::malloc (sizeof (block) * size_));
-      if (! _array || ! _tail || ! _tail0 || ! _ninfo || ! _block)
-#else
-      if (! _array || ! _tail || ! _tail0)
-#endif
-        _err (__FILE__, __LINE__, "memory allocation failed\n");
-      if (std::fseek (fp, static_cast <long> (offset), SEEK_SET) != 0) return -1;
-      if (length_ != std::fread (_tail,  sizeof (char), length_, fp) ||
-          size_   != std::fread (_array, sizeof (node), size_,   fp))
-        return -1;
-      std::fclose (fp);
-      _size = static_cast <int> (size_);
+      if (! _attach (head, size_ - offset)) { // misaligned or broken; fall back to copy
+        ::munmap (p, size_);
+        clear ();
+        return open (fn, "rb", offset, size_);
+      }
+      _realloc_array (_tail0, 1);
       *_length0 = 0;
-#ifdef USE_FAST_LOAD
-      const char* const info
-        = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".sbl");
-      fp = std::fopen (info, mode);
-      delete [] info; // resolve memory leak
-      if (! fp) return -1;
-      std::fread (&_bheadF, sizeof (int), 1, fp);
-      std::fread (&_bheadC, sizeof (int), 1, fp);
-      std::fread (&_bheadO, sizeof (int), 1, fp);
-      if (size_      != std::fread (_ninfo, sizeof (ninfo), size_, fp) ||
-          size_ >> 8 != std::fread (_block, sizeof (block), size_ >> 8, fp))
-        return -1;
-      std::fclose (fp);
-      _capacity = _size;
-      _quota  = *_length;
-      _quota0 = 1;
-#endif
+      _count ();
+      _mapped = p;
+      _mapped_size = size_;
+      _no_delete = true;
       return 0;
     }
-#ifndef USE_FAST_LOAD
+#endif
     void restore () { // restore information to update
+      ++_revision;
+      if (_leaf) _copy_tail (); // unshare
+      if (_no_delete) _promote ();
+      if (! _tail0) _realloc_array (_tail0, 1); // frozen
       if (! _block) _restore_block ();
-      if (! _ninfo) _restore_ninfo ();
+      if (! _has_ninfo ()) _restore_ninfo ();
       _capacity = _size;
       _quota  = *_length;
       _quota0 = 1;
     }
-#endif
     void set_array (void* p, size_t size_ = 0) { // ad-hoc
       clear (false);
+      if (std::memcmp (p, _magic (), sizeof (file_header ().magic)) == 0) {
+        if (! _attach (static_cast <char*> (p),
+                       size_ ? size_ * unit_size () : static_cast <size_t> (-1)))
+          _err (__FILE__, __LINE__, "broken trie\n");
+        _count ();
+        _no_delete = true;
+        return;
+      }
       if (size_)
-        size_ = size_ * unit_size () - static_cast <size_t> (*static_cast <int*> (p));
+        size_ = size_ * unit_size () - static_cast <size_t> (*static_cast <index_type*> (p));
       _tail  = static_cast <char*> (p);
       _array = reinterpret_cast <node*> (_tail + *_length);
-      _size  = static_cast <int> (size_ / unit_size () + (size_ % unit_size () ? 1 : 0));
+      _size  = static_cast <index_type> (size_ / unit_size () + (size_ % unit_size () ? 1 : 0));
+      _count ();
       _no_delete = true;
     }
     const void* array () const { return _array; }
     void clear (const bool reuse = true) {
-      if (_no_delete) _array = 0, _tail = 0;
-      if (_array) std::free (_array); _array = 0;
-      if (_tail)  std::free (_tail);  _tail  = 0;
-      if (_tail0) std::free (_tail0); _tail0 = 0;
-      if (_ninfo) std::free (_ninfo); _ninfo = 0;
-      if (_block) std::free (_block); _block = 0;
+      if (_no_delete) _array = 0, _tail = 0, _leaf = 0;
+      _unmap ();
+      _free_array (_array);
+      _free_array (_tail);
+      _free_array (_tail0);
+      _free_array (_ninfo);
+      _free_array (_block);
+      _free_array (_leaf);
       _bheadF = _bheadC = _bheadO = _capacity = _size = _quota = _quota0 = 0;
+      _num_keys = _num_nodes = _num_values = 0;
+      ++_revision;
+      _clear_garbage ();
       if (reuse) _initialize ();
       _no_delete = false;
     }
     // return the first child for a tree rooted by a given node
-    int begin (npos_t& from, size_t& len) {
-#ifndef USE_FAST_LOAD
-      if (! _ninfo) _restore_ninfo ();
-#endif
-      int base = from >> 32 ? - static_cast <int> (from >> 32) : _array[from].base;
+    index_type begin (npos_t& from, size_t& len) {
+      if (! _has_ninfo ()) _restore_ninfo ();
+      index_type base = from >> NODE_BITS ? - static_cast <index_type> (_tail_of (from)) : _array[from].base;
       if (base >= 0) { // on trie
-        uchar c = _ninfo[from].child;
-        if (! from && ! (c = _ninfo[base ^ c].sibling)) // bug fix
+        uchar c = _info (from).child;
+        if (! from && ! (c = _info (base ^ c).sibling)) // bug fix
           return CEDAR_NO_PATH; // no entry
         for (; c && base >= 0; ++len) {
           from = static_cast <size_t> (base) ^ c;
           base = _array[from].base;
-          c    = _ninfo[from].child;
+          c    = _info (from).child;
         }
-        if (base >= 0) return _array[base ^ c].base;
+        if (base >= 0) return _value_id (_array[base ^ c]);
       }
       const size_t len_ = std::strlen (&_tail[-base]);
-      from &= TAIL_OFFSET_MASK;
-      from |= static_cast <npos_t> (static_cast <size_t> (-base) + len_) << 32;
+      _set_tail (from, static_cast <size_t> (-base) + len_);
       len += len_;
-      return *reinterpret_cast <int*> (&_tail[-base] + len_ + 1);
+      return _value_id (&_tail[-base] + len_ + 1, _node_of (from));
     }
     // return the next child if any
-    int next (npos_t& from, size_t& len, const npos_t root = 0) {
+    index_type next (npos_t& from, size_t& len, const npos_t root = 0) {
       uchar c = 0;
-      if (const int offset = static_cast <int> (from >> 32)) { // on tail
-        if (root >> 32) return CEDAR_NO_PATH;
-        from &= TAIL_OFFSET_MASK;
-        len -= static_cast <size_t> (offset - (-_array[from].base));
+      if (const size_t offset = _tail_of (from)) { // on tail
+        if (root >> NODE_BITS) return CEDAR_NO_PATH;
+        from = _node_of (from);
+        len -= offset - static_cast <size_t> (-_array[from].base);
       } else
-        c    = _ninfo[_array[from].base ^ 0].sibling;
+        c    = _info (_array[from].base ^ 0).sibling;
       for (; ! c && from != root; --len) {
-        c    = _ninfo[from].sibling;
+        c    = _info (from).sibling;
         from = static_cast <size_t> (_array[from].check);
       }
       if (! c) return CEDAR_NO_PATH;
@@ -496,77 +1366,877 @@ namespace cedar {
     }
     npos_t tracking_node[NUM_TRACKING_NODES + 1];
   private:
+    template <typename, const size_t, const size_t> friend class sharded_da;
+    template <typename> friend class aho_corasick;
+    template <typename> friend class top_k;
     // currently disabled; implement these if you need
     da (const da&);
     da& operator= (const da&);
-    node*   _array;
-    union { char* _tail;  int* _length;  };
-    union { int*  _tail0; int* _length0; };
-    ninfo*  _ninfo;
-    block*  _block;
-    int     _bheadF;  // first block of Full;   0
-    int     _bheadC;  // first block of Closed; 0 if no Closed
-    int     _bheadO;  // first block of Open;   0 if no Open
-    int     _capacity;
-    int     _size;
-    int     _quota;
-    int     _quota0;
-    int     _no_delete;
-    short   _reject[257];
+    node*      _array;
+    union { char* _tail;  index_type* _length;  };
+    union { index_type* _tail0; index_type* _length0; };
+    ninfo*     _ninfo;
+    block*     _block;
+    leaf_block* _leaf; // ranks and values of suffixes on a shared _tail
+    index_type _bheadF;  // first block of Full;   0
+    index_type _bheadC;  // first block of Closed; 0 if no Closed
+    index_type _bheadO;  // first block of Open;   0 if no Open
+    index_type _capacity;
+    index_type _size;
+    index_type _quota;
+    index_type _quota0;
+    int        _no_delete;
+    void*      _mapped;      // region mapped by open_mmap ()
+    size_t     _mapped_size;
+    index_type _num_keys;
+    index_type _num_nodes;  // non-empty nodes but the root
+    index_type _num_values; // values on _tail for terminal nodes (WIDE_VALUE)
+    size_t     _revision;   // see revision ()
+    enum { WIDE_VALUE = sizeof (value_type) > sizeof (int) };
+    struct value_probe { char c; value_type v; };
+    enum { VALUE_ALIGN = WIDE_VALUE ? sizeof (value_probe) - sizeof (value_type) : 1 }; // see _pad ()
+    enum { NODE_BITS  = sizeof (index_type) > sizeof (int) ? 40 : 32 }; // see _node_of ()
+    enum { NUM_SMALL_SIZES = 64, NUM_FREE_LISTS = NUM_SMALL_SIZES + 32,
+           MIN_FREE_SIZE = 2 * sizeof (index_type) };
+    index_type _garbage; // dead bytes in _tail
+    index_type _free[NUM_FREE_LISTS]; // dead regions by size class
+    short      _reject[257];
+#ifdef USE_STATS
+    stats_type _stats;
+    struct relocation_scope { // bins the nodes moved in an update
+      stats_type& s;
+      const size_t relocated;
+      explicit relocation_scope (stats_type& s_) : s (s_), relocated (s_.relocated) {}
+      ~relocation_scope () {
+        int i = 0;
+        for (size_t n = s.relocated - relocated; n && i < NUM_RELOCATION_BINS - 1; n >>= 1) ++i;
+        ++s.relocation_hist[i];
+      }
+    };
+#endif
+    enum { NUM_STREAMS = 16 };
+    struct stream { // a lookup in batched exactMatchSearch ()
+      const char* key;
+      size_t      len;
+      size_t      pos;   // > len if the next node holds the value
+      size_t      id;
+      npos_t      from;
+      npos_t      to;    // node to visit next
+      bool        tail;  // visit _tail next
+    };
     //
     static void _err (const char* fn, const int ln, const char* msg)
     { std::fprintf (stderr, "cedar: %s [%d]: %s", fn, ln, msg); std::exit (1); }
+    static bool _zero (const void* p, size_t n) {
+      for (const char* c = static_cast <const char*> (p); n; --n) if (*c++) return false;
+      return true;
+    }
+    template <typename T>
+    static void _free_array (T*& p) { allocator_type::release (p); p = 0; }
+    // every array of da is (re)allocated here, through allocator_type
     template <typename T>
-    static void _realloc_array (T*& p, const int size_n, const int size_p = 0) {
-      void* tmp = std::realloc (p, sizeof (T) * static_cast <size_t> (size_n));
+    static void _realloc_array (T*& p, const index_type size_n, const index_type size_p = 0) {
+      const size_t size = sizeof (T) * static_cast <size_t> (size_n);
+      index_type end = size_n; // of elements to initialize
+      size_t dirty = size;
+      void* tmp = allocator_type::reallocate (p, size, dirty);
       if (! tmp)
         //std::free (p), _err (__FILE__, __LINE__, "memory reallocation failed\n");
         throw std::runtime_error("memory reallocation failed");
       p = static_cast <T*> (tmp);
       static const T T0 = T ();
-      for (T* q (p + size_p), * const r (p + size_n); q != r; ++q) *q = T0;
+      if (dirty < size && _zero (&T0, sizeof (T))) { // leave zero pages untouched
+        const index_type e = static_cast <index_type> ((dirty + sizeof (T) - 1) / sizeof (T));
+        end = e < size_p ? size_p : e;
+      }
+      for (T* q (p + size_p), * const r (p + end); q != r; ++q) *q = T0;
     }
-    void _initialize () { // initilize the first special block
-      _realloc_array (_array, 256, 256);
-      _realloc_array (_tail,  sizeof (int));
-      _realloc_array (_tail0, 1);
-      _realloc_array (_ninfo, 256);
-      _realloc_array (_block, 1);
-      _array[0] = node (0, -1);
-      for (int i = 1; i < 256; ++i)
-        _array[i] = node (i == 1 ? -255 : - (i - 1), i == 255 ? -1 : - (i + 1));
-      _capacity = _size = 256;
-      _block[0].ehead = 1; // bug fix for erase
-      _quota  = *_length  = static_cast <int> (sizeof (int));
-      _quota0 = 1;
-      for (size_t i = 0 ; i <= NUM_TRACKING_NODES; ++i) tracking_node[i] = 0;
-      for (short  i = 0; i <= 256; ++i) _reject[i] = i + 1;
+    int _save_raw (const char* fn, const char* mode) const {
+      FILE* fp = std::fopen (fn, mode);
+      if (! fp) return -1;
+      std::fwrite (_tail,  sizeof (char), static_cast <size_t> (*_length), fp);
+      std::fwrite (_array, sizeof (node), static_cast <size_t> (_size), fp);
+      std::fclose (fp);
+#ifdef USE_FAST_LOAD
+      const char* const info
+        = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".sbl");
+      fp = std::fopen (info, mode);
+      delete [] info; // resolve memory leak
+      if (! fp) return -1;
+      std::fwrite (&_bheadF, sizeof (index_type), 1, fp);
+      std::fwrite (&_bheadC, sizeof (index_type), 1, fp);
+      std::fwrite (&_bheadO, sizeof (index_type), 1, fp);
+      if (! FUSED) std::fwrite (_ninfo, sizeof (ninfo), static_cast <size_t> (_size), fp);
+      std::fwrite (_block, sizeof (block), static_cast <size_t> (_size >> 8), fp);
+      std::fclose (fp);
+#endif
+      return 0;
     }
-    // follow/create edge
-    template <typename T>
-    int _follow (npos_t& from, const uchar& label, T& cf) {
-      int to = 0;
-      const int base = _array[from].base;
-      if (base < 0 || _array[to = base ^ label].check < 0) {
-        to = _pop_enode (base, label, static_cast <int> (from));
-        _push_sibling (from, to ^ label, label, base >= 0);
-      } else if (_array[to].check != static_cast <int> (from))
-        to = _resolve (from, base, label, cf);
-      return to;
+    int _open_raw (FILE* fp, const char* fn, const char* mode, const size_t offset, size_t size_) {
+      if (std::fseek (fp, static_cast <long> (offset), SEEK_SET) != 0) return -1;
+      index_type len = 0;
+      if (std::fread (&len, sizeof (index_type), 1, fp) != 1) return -1;
+      const size_t length_ = static_cast <size_t> (len);
+      if (size_ <= offset + length_) return -1;
+      // set array
+      clear (false);
+      size_ = (size_ - offset - length_) / sizeof (node);
+      _realloc_array (_array, static_cast <index_type> (size_), static_cast <index_type> (size_));
+      _realloc_array (_tail,  len, len);
+      _realloc_array (_tail0, 1, 1);
+#ifdef USE_FAST_LOAD
+      if (! FUSED) _realloc_array (_ninfo, static_cast <index_type> (size_), static_cast <index_type> (size_));
+      _realloc_array (_block, static_cast <index_type> (size_), static_cast <index_type> (size_));
+#endif
+      if (std::fseek (fp, static_cast <long> (offset), SEEK_SET) != 0) return -1;
+      if (length_ != std::fread (_tail,  sizeof (char), length_, fp) ||
+          size_   != std::fread (_array, sizeof (node), size_,   fp))
+        return -1;
+      std::fclose (fp);
+      _size = static_cast <index_type> (size_);
+      *_length0 = 0;
+      _count ();
+#ifdef USE_FAST_LOAD
+      const char* const info
+        = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".sbl");
+      fp = std::fopen (info, mode);
+      delete [] info; // resolve memory leak
+      if (! fp) return -1;
+      std::fread (&_bheadF, sizeof (index_type), 1, fp);
+      std::fread (&_bheadC, sizeof (index_type), 1, fp);
+      std::fread (&_bheadO, sizeof (index_type), 1, fp);
+      if ((! FUSED && size_ != std::fread (_ninfo, sizeof (ninfo), size_, fp)) ||
+          size_ >> 8 != std::fread (_block, sizeof (block), size_ >> 8, fp))
+        return -1;
+      std::fclose (fp);
+      _capacity = _size;
+      _quota  = *_length;
+      _quota0 = 1;
+#else
+      (void) fn, (void) mode; // for the .sbl file
+#endif
+      return 0;
+    }
+    static const char* _magic () { return "\x89" "cedar\r\n"; }
+    static void _init_header (file_header& h, const bool leaf = true) {
+      std::memset (&h, 0, sizeof (file_header));
+      std::memcpy (h.magic, _magic (), sizeof (h.magic));
+      h.version      = leaf ? FILE_VERSION : 1;
+      h.header_size  = static_cast <int> (sizeof (file_header) - (leaf ? 0 : sizeof (section)));
+      h.ordered      = ORDERED;
+      h.value_size   = static_cast <int> (sizeof (value_type));
+      h.node_size    = static_cast <int> (sizeof (node));
+      h.no_value     = NO_VALUE;
+      h.no_path      = NO_PATH;
+      h.num_sections = leaf ? NUM_SECTIONS : SEC_LEAF;
+    }
+    static bool _is_header (const file_header& h)
+    { return std::memcmp (h.magic, _magic (), sizeof (h.magic)) == 0; }
+    // check the header matches this type and its sections lie in size_ bytes;
+    // clear SEC_LEAF of version 1
+    static bool _valid_header (file_header& h, const size_t size_) {
+      file_header h_;
+      _init_header (h_, h.version != 1);
+      if (std::memcmp (&h, &h_, sizeof (file_header) - sizeof (h.sec)) != 0)
+        return false;
+      if (h.version == 1) h.sec[SEC_LEAF] = section ();
+      for (int i = 0; i < NUM_SECTIONS; ++i)
+        if (h.sec[i].offset > size_ || h.sec[i].size > size_ - h.sec[i].offset)
+          return false;
+      const npos_t n = h.sec[SEC_ARRAY].size / sizeof (node);
+      if (h.sec[SEC_TAIL].size < sizeof (index_type) || h.sec[SEC_TAIL].size > _max_index () ||
+          ! n || n % 256 || n > _max_index () || n * sizeof (node) != h.sec[SEC_ARRAY].size ||
+          h.sec[SEC_TAIL].offset % sizeof (index_type) || h.sec[SEC_ARRAY].offset % sizeof (index_type))
+        return false;
+      const bool restore_ = h.sec[SEC_BLOCK].size;
+      if (h.sec[SEC_LEAF].size && // a shared _tail is only for search
+          (restore_ || h.sec[SEC_LEAF].size % sizeof (leaf_block) ||
+           h.sec[SEC_LEAF].size < ((n >> 8) + 1) * sizeof (leaf_block) ||
+           h.sec[SEC_LEAF].offset % sizeof (index_type)))
+        return false;
+      return h.sec[SEC_NINFO].size == (restore_ && ! FUSED ? n * sizeof (ninfo) : 0) &&
+             h.sec[SEC_BLOCK].size == (restore_ ? (n >> 8) * sizeof (block) : 0) &&
+             h.sec[SEC_BHEAD].size == (restore_ ? sizeof (index_type) * 3 : 0);
+    }
+    int _open_sections (FILE* fp, file_header& h, const size_t offset, const size_t size_) {
+      if (! _valid_header (h, size_)) return -1;
+      const section* const sec = h.sec;
+      const bool restore_ = sec[SEC_BLOCK].size;
+      clear (false);
+      const index_type n = static_cast <index_type> (sec[SEC_ARRAY].size / sizeof (node));
+      _realloc_array (_array, n, n);
+      _realloc_array (_tail,  static_cast <index_type> (sec[SEC_TAIL].size), static_cast <index_type> (sec[SEC_TAIL].size));
+      _realloc_array (_tail0, 1, 1);
+      if (restore_) {
+        if (! FUSED) _realloc_array (_ninfo, n, n);
+        _realloc_array (_block, n >> 8, n >> 8);
+      }
+      const index_type u = static_cast <index_type> (sec[SEC_LEAF].size / sizeof (leaf_block));
+      if (u) _realloc_array (_leaf, u, u);
+      index_type bhead[3];
+      void* const data[NUM_SECTIONS] = { _tail, _array, _ninfo, _block, bhead, _leaf };
+      for (int i = 0; i < NUM_SECTIONS; ++i)
+        if (sec[i].size &&
+            (std::fseek (fp, static_cast <long> (offset + sec[i].offset), SEEK_SET) != 0 ||
+             std::fread (data[i], 1, sec[i].size, fp) != sec[i].size))
+          { clear (); return -1; }
+      if (*_length != static_cast <index_type> (sec[SEC_TAIL].size)) { clear (); return -1; }
+      _size = static_cast <index_type> (sec[SEC_ARRAY].size / sizeof (node));
+      if (_leaf && _leaf_bytes () != sec[SEC_LEAF].size) { clear (); return -1; }
+      *_length0 = 0;
+      _count ();
+      if (restore_) {
+        _bheadF = bhead[0], _bheadC = bhead[1], _bheadO = bhead[2];
+        _capacity = _size;
+        _quota  = *_length;
+        _quota0 = 1;
+      }
+      return 0;
+    }
+    // point _tail and _array to a saved trie in memory without copy
+    bool _attach (char* head, const size_t size_) {
+      file_header h;
+      if (size_ >= sizeof (file_header)) std::memcpy (&h, head, sizeof (file_header));
+      if (size_ >= sizeof (file_header) && _is_header (h)) {
+        if (! _valid_header (h, size_)) return false;
+        char* const tail = head + h.sec[SEC_TAIL].offset;
+        if (*reinterpret_cast <index_type*> (tail) != static_cast <index_type> (h.sec[SEC_TAIL].size))
+          return false;
+        leaf_block* const leaf = h.sec[SEC_LEAF].size ?
+          reinterpret_cast <leaf_block*> (head + h.sec[SEC_LEAF].offset) : 0;
+        const index_type n = static_cast <index_type> (h.sec[SEC_ARRAY].size / sizeof (node));
+        if (_leaf_bytes (leaf, n) != h.sec[SEC_LEAF].size) return false;
+        _tail  = tail;
+        _array = reinterpret_cast <node*> (head + h.sec[SEC_ARRAY].offset);
+        _size  = n;
+        _leaf  = leaf;
+        return true;
+      }
+      // old format; _tail followed by _array
+      index_type len = 0;
+      std::memcpy (&len, head, sizeof (index_type));
+      const size_t length_ = static_cast <size_t> (len);
+      if (len < static_cast <index_type> (sizeof (index_type)) || size_ <= length_ ||
+          length_ % sizeof (index_type)) // misaligned array
+        return false;
+      _tail  = head;
+      _array = reinterpret_cast <node*> (head + length_);
+      _size  = static_cast <index_type> ((size_ - length_) / sizeof (node));
+      return true;
+    }
+    static void _prefetch (const void* p) {
+#ifdef __GNUC__
+      __builtin_prefetch (p);
+#endif
+    }
+    void _start_stream (stream& t, const char* key, const size_t len, const size_t id) const {
+      t.key = key, t.len = len, t.pos = 0, t.id = id, t.from = 0;
+      _advance_stream (t, _array[0].base);
+    }
+    // locate and prefetch the node (or tail) to visit next
+    void _advance_stream (stream& t, const index_type base) const {
+      if ((t.tail = base < 0)) { _prefetch (&_tail[-base]); return; }
+      t.to = static_cast <npos_t> (base) ^ (t.pos < t.len ? static_cast <uchar> (t.key[t.pos]) : 0);
+      ++t.pos;
+      _prefetch (&_array[t.to]);
+    }
+    // memory held for updates
+    size_t _footprint () const {
+      if (_no_delete) return 0;
+      return (sizeof (node) + (_ninfo ? sizeof (ninfo) : 0)) * static_cast <size_t> (_capacity)
+        + (_block ? sizeof (block) * static_cast <size_t> (_capacity >> 8) : 0)
+        + static_cast <size_t> (_quota) + sizeof (index_type) * static_cast <size_t> (_quota0)
+        + _leaf_bytes ();
+    }
+    // copy live suffixes and values to a new _tail, which also unshares
+    // a shared _tail; padding to align wide values is left as garbage
+    void _copy_tail () {
+      ++_revision;
+      if (_no_delete) _promote ();
+      union { char* tail; index_type* length; } t;
+      size_t length_ = static_cast <size_t> (*_length - _garbage);
+      if (_leaf) {
+        length_ = sizeof (index_type) + sizeof (value_type) * static_cast <size_t> (_num_values);
+        for (index_type to = 0; to < _size; ++to)
+          if (_on_tail (to))
+            length_ += std::strlen (&_tail[-_array[to].base]) + 1 + sizeof (value_type);
+      }
+      length_ += (VALUE_ALIGN - 1) * static_cast <size_t> (_num_keys);
+      t.tail = 0;
+      _realloc_array (t.tail, static_cast <index_type> (length_), static_cast <index_type> (length_));
+      *t.length = static_cast <index_type> (sizeof (index_type));
+      index_type garbage = 0;
+      for (index_type to = 0; to < _size; ++to) {
+        node& n = _array[to];
+        if (WIDE_VALUE && n.check >= 0 && _array[n.check].base == to && n.base) {
+          const index_type skip = _pad (*t.length + static_cast <index_type> (sizeof (value_type)));
+          std::memset (&t.tail[*t.length], 0, static_cast <size_t> (skip));
+          *t.length += skip, garbage += skip;
+          std::memcpy (&t.tail[*t.length], &_tail[n.base], sizeof (value_type));
+          n.base = *t.length;
+          *t.length += static_cast <index_type> (sizeof (value_type));
+        } else if (_on_tail (to)) {
+          const char* const tail_ = &_tail[-n.base];
+          const index_type i = static_cast <index_type> (std::strlen (tail_) + 1);
+          const index_type skip = _pad (*t.length + i + static_cast <index_type> (sizeof (value_type)));
+          std::memset (&t.tail[*t.length], 0, static_cast <size_t> (skip));
+          *t.length += skip, garbage += skip;
+          char* const tail = &t.tail[*t.length];
+          n.base = - *t.length;
+          std::memcpy (tail, tail_, static_cast <size_t> (i));
+          std::memcpy (&tail[i], _leaf ? _leaf_value (to) : &tail_[i], sizeof (value_type));
+          *t.length += i + static_cast <index_type> (sizeof (value_type));
+        }
+      }
+      allocator_type::release (_tail);
+      _tail = t.tail;
+      _realloc_array (_tail,  *_length,  *_length);
+      _quota  = *_length;
+      _realloc_array (_tail0, 1);
+      _quota0 = 1;
+      _free_array (_leaf);
+      _clear_garbage ();
+      _garbage = garbage;
+    }
+    // release spare capacity
+    void _shrink () {
+      _realloc_array (_array, _size, _size);
+      if (! FUSED) _realloc_array (_ninfo, _size, _size);
+      _realloc_array (_block, _size >> 8, _size >> 8);
+      _realloc_array (_tail,  *_length, *_length);
+      _capacity = _size;
+      _quota    = *_length;
+    }
+    template <typename T>
+    static void _swap_value (T& a, T& b) { const T c (a); a = b; b = c; }
+    void _swap (da& t) {
+      _swap_value (_array, t._array);
+      _swap_value (_tail,  t._tail);
+      _swap_value (_tail0, t._tail0);
+      _swap_value (_ninfo, t._ninfo);
+      _swap_value (_block, t._block);
+      _swap_value (_leaf,  t._leaf);
+      _swap_value (_bheadF, t._bheadF);
+      _swap_value (_bheadC, t._bheadC);
+      _swap_value (_bheadO, t._bheadO);
+      _swap_value (_capacity, t._capacity);
+      _swap_value (_size,   t._size);
+      _swap_value (_quota,  t._quota);
+      _swap_value (_quota0, t._quota0);
+      _swap_value (_no_delete, t._no_delete);
+      _swap_value (_mapped, t._mapped);
+      _swap_value (_mapped_size, t._mapped_size);
+      _swap_value (_garbage, t._garbage);
+      _swap_value (_num_keys,   t._num_keys);
+      _swap_value (_num_nodes,  t._num_nodes);
+      _swap_value (_num_values, t._num_values);
+      for (int i = 0; i < NUM_FREE_LISTS; ++i) _swap_value (_free[i], t._free[i]);
+      for (int i = 0; i <= 256; ++i) _swap_value (_reject[i], t._reject[i]);
+      for (size_t i = 0; i <= NUM_TRACKING_NODES; ++i) tracking_node[i] = 0;
+    }
+    // copy arrays on a mapped or borrowed region to private memory
+    void _promote () {
+      const node* const array = _array;
+      const char* const tail  = _tail;
+      const leaf_block* const leaf = _leaf;
+      const size_t leaf_bytes = _leaf_bytes ();
+      index_type len = 0;
+      std::memcpy (&len, tail, sizeof (index_type));
+      _array = 0, _tail = 0, _leaf = 0;
+      _realloc_array (_array, _size, _size);
+      _realloc_array (_tail,  len, len);
+      std::memcpy (_array, array, sizeof (node) * static_cast <size_t> (_size));
+      std::memcpy (_tail,  tail,  static_cast <size_t> (len));
+      if (leaf) {
+        const index_type u = static_cast <index_type> (leaf_bytes / sizeof (leaf_block));
+        _realloc_array (_leaf, u, u);
+        std::memcpy (_leaf, leaf, leaf_bytes);
+      }
+      if (! _tail0) _realloc_array (_tail0, 1);
+      _unmap ();
+      _no_delete = false;
+    }
+    void _unmap () {
+#ifndef _WIN32
+      if (_mapped) ::munmap (_mapped, _mapped_size);
+#endif
+      _mapped = 0, _mapped_size = 0;
+    }
+    void _initialize () { // initilize the first special block
+      _realloc_array (_array, 256, 256);
+      _realloc_array (_tail,  sizeof (index_type));
+      _realloc_array (_tail0, 1);
+      if (! FUSED) _realloc_array (_ninfo, 256);
+      _realloc_array (_block, 1);
+      _array[0] = node (0, -1);
+      for (int i = 1; i < 256; ++i)
+        _array[i] = node (i == 1 ? -255 : - (i - 1), i == 255 ? -1 : - (i + 1));
+      _capacity = _size = 256;
+      _block[0].ehead = 1; // bug fix for erase
+      _quota  = *_length  = static_cast <index_type> (sizeof (index_type));
+      _quota0 = 1;
+      for (size_t i = 0 ; i <= NUM_TRACKING_NODES; ++i) tracking_node[i] = 0;
+      for (short  i = 0; i <= 256; ++i) _reject[i] = i + 1;
+    }
+    // an exact size for a small region; otherwise [2^i, 2^(i+1)) bytes
+    static int _size_class (index_type size) {
+      if (size < NUM_SMALL_SIZES) return size;
+      int c = NUM_SMALL_SIZES - 6;
+      while (size >>= 1) ++c;
+      return c;
+    }
+    void _clear_garbage () {
+      _garbage = 0;
+      for (int i = 0; i < NUM_FREE_LISTS; ++i) _free[i] = 0;
+    }
+    // recount keys, nodes and dead tail bytes of a loaded trie
+    void _count () {
+      index_type live = static_cast <index_type> (sizeof (index_type));
+      _num_keys = _num_nodes = _num_values = 0;
+      for (index_type to = 0; to < _size; ++to) {
+        const node& n = _array[to];
+        if (n.check < 0) continue;
+        ++_num_nodes;
+        if (_array[n.check].base == to) {
+          ++_num_keys;
+          if (WIDE_VALUE && n.base)
+            ++_num_values, live += static_cast <index_type> (sizeof (value_type));
+        } else if (n.base < 0) {
+          ++_num_keys;
+          if (! _leaf)
+            live += static_cast <index_type> (std::strlen (&_tail[-n.base]) + 1 + sizeof (value_type));
+        }
+      }
+      _garbage = _leaf ? _lead () : *_length - live; // a shared _tail is packed
+    }
+    // keep a dead region of _tail for reuse; a region large enough heads
+    // itself with its size and the next region in the list, while a small
+    // one is cut into slots for zero-length suffixes, which end aligned
+    void _free_tail (const index_type offset, const index_type size) {
+      _garbage += size;
+      if (size >= static_cast <index_type> (MIN_FREE_SIZE)) {
+        const int c = _size_class (size);
+        const index_type head[2] = { size, _free[c] };
+        std::memcpy (&_tail[offset], head, sizeof (head));
+        _free[c] = offset;
+        return;
+      }
+      const index_type size0 = static_cast <index_type> (1 + sizeof (value_type));
+      for (index_type i = offset + _pad (offset + size0); i + size0 <= offset + size;
+           i += size0 + _pad (size0)) {
+        if (_quota0 == ++*_length0) {
+#ifdef USE_EXACT_FIT
+          _quota0 += *_length0 >= MAX_ALLOC_SIZE ? MAX_ALLOC_SIZE : *_length0;
+#else
+          _quota0 += _quota0;
+#endif
+          CEDAR_STAT (++_stats.realloc);
+          CEDAR_STAT (_stats.realloc_bytes += sizeof (index_type) * static_cast <size_t> (*_length0));
+          _realloc_array (_tail0, _quota0, *_length0);
+        }
+        _tail0[*_length0] = i;
+      }
+    }
+    // take a dead region of needed bytes, returning its rest; 0 if none
+    index_type _alloc_tail (const index_type needed) {
+      for (int c = _size_class (needed); c < NUM_FREE_LISTS; ++c) {
+        const index_type offset = _free[c];
+        if (! offset) continue;
+        index_type head[2];
+        std::memcpy (head, &_tail[offset], sizeof (head));
+        if (head[0] < needed) continue; // only in the first class
+        _free[c] = head[1];
+        _garbage -= head[0];
+        if (head[0] > needed) _free_tail (offset + needed, head[0] - needed);
+        return offset;
+      }
+      return 0;
+    }
+    // a region of needed bytes in _tail that ends aligned; reused if any,
+    // or appended
+    index_type _take_tail (const index_type needed) {
+      const index_type slack = VALUE_ALIGN - 1;
+      if (const index_type offset = _alloc_tail (needed + slack)) {
+        const index_type skip = _pad (offset + needed);
+        if (skip) _free_tail (offset, skip);
+        if (skip < slack) _free_tail (offset + skip + needed, slack - skip);
+        return offset + skip;
+      }
+      const index_type skip = _pad (*_length + needed);
+      _reserve_tail (skip + needed);
+      if (skip) _free_tail (*_length, skip);
+      *_length += skip + needed;
+      return *_length - needed;
+    }
+    // bytes to skip so that a region ending at end ends aligned; a wide
+    // value, which ends its region, is then aligned on _tail, and so is
+    // the reference update () returns
+    static index_type _pad (const index_type end)
+    { return static_cast <index_type> ((VALUE_ALIGN - end % VALUE_ALIGN) % VALUE_ALIGN); }
+    // values wider than int are kept in _tail and addressed by offset;
+    // a terminal node gets its region when the value is first touched
+    template <const int> struct wide_tag {};
+    value_type& _ref (slot_type& v) { return _ref (v, wide_tag <WIDE_VALUE> ()); }
+    value_type& _ref (value_type& v, wide_tag <0>) { return v; }
+    value_type& _ref (index_type& v, wide_tag <1>) {
+      if (! v) {
+        const value_type v0 = value_type (0);
+        ++_num_values;
+        v = _take_tail (static_cast <index_type> (sizeof (value_type)));
+        std::memcpy (&_tail[v], &v0, sizeof (value_type));
+      }
+      return *reinterpret_cast <value_type*> (&_tail[v]);
+    }
+    void _free_value (const index_type v)
+    { if (WIDE_VALUE && v) --_num_values, _free_tail (v, static_cast <index_type> (sizeof (value_type))); }
+    // id of a value stored on _tail at p, as returned by _find ()
+    index_type _value_id (const char* p) const
+    { return WIDE_VALUE ? static_cast <index_type> (p - _tail) : *reinterpret_cast <const int*> (p); }
+    // id of the value of node to, whose suffix ends before p; with a shared
+    // _tail, a wide value is addressed past the end of _tail
+    index_type _value_id (const char* p, const npos_t to) const {
+      if (! _leaf) return _value_id (p);
+      const size_t i = sizeof (value_type) * static_cast <size_t> (_leaf_rank (to));
+      return WIDE_VALUE ? *_length + static_cast <index_type> (i) : _value_id (_leaf_values () + i);
+    }
+    // id of a value kept in a terminal node; with wide indices a value
+    // narrower than base leaves the upper bytes of base undefined
+    index_type _value_id (const node& n) const {
+      if (WIDE_VALUE || sizeof (index_type) == sizeof (int)) return n.base;
+      int v;
+      std::memcpy (&v, &n.value, sizeof (int));
+      return v;
+    }
+    value_type _value_of (const index_type i) const {
+      if (WIDE_VALUE && i < 0) return value_type (i); // CEDAR_NO_VALUE or CEDAR_NO_PATH
+      const int j = static_cast <int> (i);
+      value_type v;
+      const void* const p = ! WIDE_VALUE ? static_cast <const void*> (&j) :
+        i < *_length ? &_tail[i] : _leaf_values () + (i - *_length);
+      std::memcpy (&v, p, sizeof (value_type));
+      return v;
+    }
+    // whether node to has a suffix on _tail
+    bool _on_tail (const index_type to) const {
+      const node& n = _array[to];
+      return n.check >= 0 && _array[n.check].base != to && n.base < 0;
+    }
+    static int _popcount (unsigned x) {
+#ifdef __GNUC__
+      return __builtin_popcount (x);
+#else
+      int c = 0;
+      for (; x; x &= x - 1) ++c;
+      return c;
+#endif
+    }
+    // # nodes with suffixes before node to, which indexes its value
+    index_type _leaf_rank (const npos_t to) const {
+      const leaf_block& b = _leaf[to >> 8];
+      const unsigned i = static_cast <unsigned> (to & 255);
+      index_type r = b.rank;
+      for (unsigned j = 0; j < i >> 5; ++j) r += _popcount (b.bits[j]);
+      return r + _popcount (b.bits[i >> 5] & ((1u << (i & 31)) - 1));
+    }
+    // values follow the ranks of (_size >> 8) + 1 blocks, the last of which
+    // counts all; padded for _value_id () to read an int
+    const char* _leaf_values () const
+    { return reinterpret_cast <const char*> (_leaf + (_size >> 8) + 1); }
+    const char* _leaf_value (const npos_t to) const
+    { return _leaf_values () + sizeof (value_type) * static_cast <size_t> (_leaf_rank (to)); }
+    static size_t _leaf_bytes (const size_t num_blocks, const size_t num) {
+      return sizeof (leaf_block) * (num_blocks + 1 +
+        (sizeof (value_type) * num + sizeof (int) + sizeof (leaf_block) - 1) / sizeof (leaf_block));
+    }
+    static size_t _leaf_bytes (const leaf_block* leaf, const index_type size) {
+      if (! leaf) return 0;
+      const size_t nb = static_cast <size_t> (size >> 8);
+      return _leaf_bytes (nb, static_cast <size_t> (leaf[nb].rank));
+    }
+    size_t _leaf_bytes () const { return _leaf_bytes (_leaf, _size); }
+    struct tail_ref { // a suffix on _tail, for _share_tail ()
+      const char* p;
+      size_t      len;
+      index_type  to;
+    };
+    struct tail_ref_less { // compare from the last byte
+      bool operator () (const tail_ref& a, const tail_ref& b) const {
+        for (size_t i = 1; i <= a.len && i <= b.len; ++i)
+          if (a.p[a.len - i] != b.p[b.len - i])
+            return static_cast <uchar> (a.p[a.len - i]) < static_cast <uchar> (b.p[b.len - i]);
+        return a.len < b.len;
+      }
+    };
+    // keep each distinct suffix once; sorted from the last byte, a suffix
+    // that ends another is next to one that it ends, and points into it.
+    // the values move to _leaf, ranked by node, while wide values of
+    // terminal nodes lead _tail, aligned.  _tail must have only padding
+    void _share_tail () {
+      const size_t nb = static_cast <size_t> (_size >> 8);
+      size_t num = 0;
+      for (index_type to = 0; to < _size; ++to)
+        if (_on_tail (to)) ++num;
+      const index_type u = static_cast <index_type> (_leaf_bytes (nb, num) / sizeof (leaf_block));
+      _realloc_array (_leaf, u);
+      tail_ref* const s = static_cast <tail_ref*> (std::malloc (sizeof (tail_ref) * (num + 1)));
+      if (! s) _err (__FILE__, __LINE__, "memory allocation failed\n");
+      union { char* tail; index_type* length; } t;
+      t.tail = 0;
+      _realloc_array (t.tail, *_length + VALUE_ALIGN - 1, *_length + VALUE_ALIGN - 1);
+      *t.length = static_cast <index_type> (sizeof (index_type)) + _lead ();
+      std::memset (&t.tail[sizeof (index_type)], 0, static_cast <size_t> (_lead ()));
+      num = 0;
+      for (index_type to = 0; to < _size; ++to) {
+        node& n = _array[to];
+        leaf_block& b = _leaf[to >> 8];
+        if (! (to & 255)) b.rank = static_cast <index_type> (num);
+        if (WIDE_VALUE && n.check >= 0 && _array[n.check].base == to && n.base) {
+          std::memcpy (&t.tail[*t.length], &_tail[n.base], sizeof (value_type));
+          n.base = *t.length;
+          *t.length += static_cast <index_type> (sizeof (value_type));
+        } else if (_on_tail (to)) {
+          b.bits[(to & 255) >> 5] |= 1u << (to & 31);
+          s[num].p   = &_tail[-n.base];
+          s[num].len = std::strlen (s[num].p);
+          s[num].to  = to;
+          ++num;
+        }
+      }
+      _leaf[nb].rank = static_cast <index_type> (num);
+      std::sort (s, s + num, tail_ref_less ());
+      char* const value = const_cast <char*> (_leaf_values ());
+      index_type at = 0; // of the last suffix placed
+      for (size_t i = num; i--; ) {
+        const tail_ref& r = s[i];
+        if (i + 1 < num && r.len <= s[i + 1].len &&
+            std::memcmp (r.p, s[i + 1].p + s[i + 1].len - r.len, r.len) == 0)
+          at += static_cast <index_type> (s[i + 1].len - r.len);
+        else {
+          at = *t.length;
+          std::memcpy (&t.tail[at], r.p, r.len + 1);
+          *t.length += static_cast <index_type> (r.len + 1);
+        }
+        std::memcpy (value + sizeof (value_type) * static_cast <size_t> (_leaf_rank (r.to)),
+                     r.p + r.len + 1, sizeof (value_type));
+        _array[r.to].base = -at;
+      }
+      std::free (s);
+      allocator_type::release (_tail);
+      _tail = t.tail;
+      _realloc_array (_tail, *_length, *_length);
+      _quota = *_length;
+      _garbage = _lead ();
+    }
+    // padding before the first value on a shared _tail
+    static index_type _lead ()
+    { return _pad (static_cast <index_type> (sizeof (index_type) + sizeof (value_type))); }
+    // a cursor (npos_t) keeps a node in the lower NODE_BITS bits and, when
+    // it stops on _tail, a tail offset in the upper bits; with wide indices
+    // the offset is relative to the suffix head (+1) to fit in 24 bits
+    static npos_t _node_of (const npos_t from)
+    { return from & ((static_cast <npos_t> (1) << NODE_BITS) - 1); }
+    size_t _tail_of (const npos_t from) const {
+      const size_t at = static_cast <size_t> (from >> NODE_BITS);
+      if (NODE_BITS == 32 || ! at) return at;
+      return at - 1 + static_cast <size_t> (-_array[_node_of (from)].base);
+    }
+    void _set_tail (npos_t& from, const size_t offset) const {
+      from = _node_of (from);
+      from |= static_cast <npos_t> (NODE_BITS == 32 ? offset :
+                                    offset + 1 + _array[from].base) << NODE_BITS;
+    }
+    static npos_t _max_index () // what a cursor can address
+    { return (static_cast <npos_t> (1) << (NODE_BITS - 1)) - 1; }
+    void _reserve_tail (const index_type needed) {
+      if (_quota < *_length + needed) {
+#ifdef USE_EXACT_FIT
+        _quota += needed > *_length || needed > MAX_ALLOC_SIZE ? needed :
+                  (*_length >= MAX_ALLOC_SIZE ? MAX_ALLOC_SIZE : *_length);
+#else
+        _quota += _quota >= needed ? _quota : needed;
+#endif
+        CEDAR_STAT (++_stats.realloc);
+        CEDAR_STAT (_stats.realloc_bytes += static_cast <size_t> (*_length));
+        _realloc_array (_tail, _quota, _quota); // written before read
+      }
+      CEDAR_STAT (++_stats.tail_append);
+      CEDAR_STAT (_stats.tail_append_bytes += static_cast <size_t> (needed));
+    }
+    // check whether keys are sorted in byte order (duplicates allowed)
+    static bool _sorted (size_t num, const char** key, const size_t* len) {
+      for (size_t i = 0; i < num; ++i) {
+        if (! len[i]) return false; // let update () reject zero-length key
+        if (! i) continue;
+        const size_t n = len[i - 1] < len[i] ? len[i - 1] : len[i];
+        const int r = std::memcmp (key[i - 1], key[i], n);
+        if (r > 0 || (r == 0 && len[i - 1] > len[i])) return false;
+      }
+      return true;
+    }
+    // place sorted keys [begin, end) sharing a prefix of length depth below from;
+    // each sibling set is located at once, so no conflict resolution is needed
+    void _build (const npos_t from, const size_t begin, const size_t end, const size_t depth,
+                 const char** key, const size_t* len, const value_type* val) {
+      if (from && (end - begin == 1 ||
+                   (len[begin] == len[end - 1] &&
+                    std::memcmp (key[begin], key[end - 1], len[begin]) == 0))) {
+        value_type v = value_type (0); // a single (possibly duplicated) key
+        for (size_t i = begin; i < end; ++i) v += val ? val[i] : value_type (i);
+        const index_type needed = static_cast <index_type> (len[begin] - depth + 1 + sizeof (value_type));
+        const index_type skip = _pad (*_length + needed);
+        _reserve_tail (skip + needed);
+        if (skip) _free_tail (*_length, skip), *_length += skip;
+        char* const tail = &_tail[*_length];
+        std::memcpy (tail, key[begin] + depth, len[begin] - depth);
+        tail[len[begin] - depth] = '\0';
+        std::memcpy (&tail[len[begin] - depth + 1], &v, sizeof (value_type));
+        _array[from].base = -*_length;
+        *_length += needed;
+        ++_num_keys;
+        return;
+      }
+      uchar label[256];
+      int nl = 0;
+      for (size_t i = begin; i < end; i = _group_end (i, end, depth, key, len))
+        label[nl++] = len[i] == depth ? 0 : static_cast <uchar> (key[i][depth]); // 0: terminal
+      const uchar* const last = &label[nl - 1];
+      const index_type base = from ? _find_place_bulk (&label[0], last) ^ label[0] : 0;
+      _array[from].base = base;
+      uchar* c = from ? &_info (from).child : &_info (0).sibling;
+      for (const uchar* p = &label[0]; p <= last; ++p) {
+        _pop_enode (base, *p, static_cast <index_type> (from));
+        *c = *p;
+        c = &_info (base ^ *p).sibling;
+      }
+      *c = 0;
+      for (size_t i = begin, j = 0; i < end; i = j) { // fill terminal value or recurse
+        j = _group_end (i, end, depth, key, len);
+        if (len[i] == depth) {
+          for (size_t k = i; k < j; ++k)
+            _ref (_array[base ^ 0].value) += val ? val[k] : value_type (k);
+          ++_num_keys;
+        } else
+          _build (static_cast <npos_t> (base ^ static_cast <uchar> (key[i][depth])),
+                  i, j, depth + 1, key, len, val);
+      }
+    }
+#if __cplusplus >= 201103L
+    static void _build_thread (da* t, const size_t begin, const size_t end,
+                               const char** key, const size_t* len, const value_type* val)
+    { t->_build (0, begin, end, 0, key, len, val); }
+    // build subtries for ranges of first bytes in parallel and splice them;
+    // non-root blocks are shifted by multiples of 256, which keeps base ^ label
+    void _build_parallel (const size_t num, const char** key, const size_t* len,
+                          const value_type* val, const size_t num_threads) {
+      size_t bound[257];
+      size_t nb = 0;
+      bound[0] = 0;
+      for (size_t i = 0; i < num; ) { // cut at first-byte boundaries
+        i = _group_end (i, num, 0, key, len);
+        if (i < num && i * num_threads >= (nb + 1) * num) bound[++nb] = i;
+      }
+      bound[++nb] = num;
+      da* const t = new da[nb];
+      std::vector <std::thread> th;
+      for (size_t k = 0; k < nb; ++k)
+        th.push_back (std::thread (_build_thread, &t[k], bound[k], bound[k + 1], key, len, val));
+      for (size_t k = 0; k < nb; ++k) th[k].join ();
+      // allocate the spliced arrays
+      index_type size_ (256), length_ (*_length);
+      for (size_t k = 0; k < nb; ++k) // with room to keep wide values aligned
+        size_ += t[k]._size - 256, length_ += *t[k]._length - static_cast <index_type> (sizeof (index_type)) + VALUE_ALIGN - 1;
+      _realloc_array (_array, size_, 256);
+      if (! FUSED) _realloc_array (_ninfo, size_, 256);
+      _realloc_array (_block, size_ >> 8, 1);
+      _realloc_array (_tail,  length_, *_length);
+      _capacity = _size = size_;
+      _quota = length_;
+      for (int i = 1; i < 256; ++i) _array[i].check = -1; // mark block 0 as empty
+      uchar* c = &_info (0).sibling; // root children in order
+      for (size_t k = 0, delta = 0; k < nb; ++k) {
+        const da& s = t[k];
+        const index_type skip = _pad (*_length - static_cast <index_type> (sizeof (index_type)));
+        *_length += skip, _garbage += skip + s._garbage; // shift tail offsets by a multiple of VALUE_ALIGN
+        const index_type d = static_cast <index_type> (delta);
+        const index_type tshift = *_length - static_cast <index_type> (sizeof (index_type));
+        for (index_type i = 1; i < s._size; ++i) {
+          const node& n = s._array[i];
+          if (i < 256 && n.check) continue; // empty or unused in block 0
+          node& n_ = _array[i < 256 ? i : i + d];
+          if (n.check < 0) { // empty ring
+            n_ = node (n.base - d, n.check - d);
+            continue;
+          }
+          n_.check = n.check < 256 ? n.check : n.check + d;
+          if (s._array[n.check].base == i) { // terminal value
+            n_.value = n.value;
+            if (WIDE_VALUE) n_.base += tshift;
+          }
+          else if (n.base >= 0) n_.base = n.base + d;
+          else n_.base = n.base - tshift;                        // tail offset
+          _info (i < 256 ? i : i + d) = s._info (i);
+          if (i < 256) *c = static_cast <uchar> (i), c = &_info (i).sibling;
+        }
+        std::memcpy (&_tail[*_length], &s._tail[sizeof (index_type)],
+                     static_cast <size_t> (*s._length) - sizeof (index_type));
+        *_length += *s._length - static_cast <index_type> (sizeof (index_type));
+        delta += static_cast <size_t> (s._size - 256);
+        _num_keys += s._num_keys, _num_nodes += s._num_nodes, _num_values += s._num_values;
+      }
+      *c = 0;
+      index_type prev = 0; // relink empty nodes in block 0
+      for (int i = 1; i < 256; ++i)
+        if (_array[i].check == -1) {
+          if (prev) _array[prev].check = -i, _array[i].base = -prev;
+          else _block[0].ehead = i;
+          prev = i;
+        }
+      if (prev)
+        _array[prev].check = -_block[0].ehead, _array[_block[0].ehead].base = -prev;
+      _restore_block ();
+      delete [] t;
+    }
+#endif
+    // end of the run of sorted keys sharing the label of key[i] at depth
+    static size_t _group_end (const size_t i, const size_t end, const size_t depth,
+                              const char** key, const size_t* len) {
+      const bool term = len[i] == depth;
+      const char c = term ? 0 : key[i][depth];
+      size_t lo (i + 1), hi (i + 1), step (1);
+      while (hi < end && (term ? len[hi] == depth : key[hi][depth] == c)) // gallop
+        lo = hi + 1, hi += step, step <<= 1;
+      if (hi > end) hi = end;
+      while (lo < hi) { // binary search in [lo, hi)
+        const size_t mid = lo + (hi - lo) / 2;
+        if (term ? len[mid] == depth : key[mid][depth] == c) lo = mid + 1; else hi = mid;
+      }
+      return lo;
+    }
+    // follow/create edge
+    template <typename T>
+    index_type _follow (npos_t& from, const uchar& label, T& cf) {
+      index_type to = 0;
+      const index_type base = _array[from].base;
+      if (base < 0 || _array[to = base ^ label].check < 0) {
+        to = _pop_enode (base, label, static_cast <index_type> (from));
+        _push_sibling (from, to ^ label, label, base >= 0);
+      } else if (_array[to].check != static_cast <index_type> (from))
+        to = _resolve (from, base, label, cf);
+      return to;
     }
     // find key from double array
-    int _find (const char* key, npos_t& from, size_t& pos, const size_t len) const {
-      npos_t offset = from >> 32;
+    index_type _find (const char* key, npos_t& from, size_t& pos, const size_t len) const {
+      npos_t offset = _tail_of (from);
       if (! offset) { // node on trie
         for (const uchar* const key_ = reinterpret_cast <const uchar*> (key);
              _array[from].base >= 0; ) {
           if (pos == len) {
             const node& n = _array[_array[from].base ^ 0];
-            if (n.check != static_cast <int> (from)) return CEDAR_NO_VALUE;
-            return n.base;
+            if (n.check != static_cast <index_type> (from)) return CEDAR_NO_VALUE;
+            return _value_id (n);
           }
           size_t to = static_cast <size_t> (_array[from].base); to ^= key_[pos];
-          if (_array[to].check != static_cast <int> (from)) return CEDAR_NO_PATH;
+          if (_array[to].check != static_cast <index_type> (from)) return CEDAR_NO_PATH;
           ++pos;
           from = to;
         }
@@ -576,48 +2246,181 @@ namespace cedar {
       const size_t pos_orig = pos; // start position in reading _tail
       const char* const tail = &_tail[offset] - pos;
       if (pos < len) {
-        do if (key[pos] != tail[pos]) break; while (++pos < len);
-        if (const npos_t moved = pos - pos_orig) {
-          from &= TAIL_OFFSET_MASK;
-          from |= (offset + moved) << 32;
-        }
+        pos = _match_tail (key, tail, pos, len);
+        if (const npos_t moved = pos - pos_orig)
+          _set_tail (from, offset + moved);
         if (pos < len) return CEDAR_NO_PATH; // input > tail, input != tail
       }
       if (tail[pos]) return CEDAR_NO_VALUE;  // input < tail
-      return *reinterpret_cast <const int*> (&tail[len + 1]);
+      return _value_id (&tail[len + 1], _node_of (from));
+    }
+    // return the first position from pos where key and tail differ, or len;
+    // compare 32 or 16 bytes at once while both stay in bounds
+    size_t _match_tail (const char* key, const char* tail, size_t pos, const size_t len) const {
+#if defined (__GNUC__) && defined (__SSE2__)
+      const char* const end = _tail + *_length;
+#ifdef __AVX2__
+      for (; pos + 32 <= len && tail + pos + 32 <= end; pos += 32) {
+        const __m256i a = _mm256_loadu_si256 (reinterpret_cast <const __m256i*> (key + pos));
+        const __m256i b = _mm256_loadu_si256 (reinterpret_cast <const __m256i*> (tail + pos));
+        if (const unsigned mask = ~static_cast <unsigned> (_mm256_movemask_epi8 (_mm256_cmpeq_epi8 (a, b))))
+          return pos + static_cast <size_t> (__builtin_ctz (mask));
+      }
+#endif
+      for (; pos + 16 <= len && tail + pos + 16 <= end; pos += 16) {
+        const __m128i a = _mm_loadu_si128 (reinterpret_cast <const __m128i*> (key + pos));
+        const __m128i b = _mm_loadu_si128 (reinterpret_cast <const __m128i*> (tail + pos));
+        if (const unsigned mask = ~static_cast <unsigned> (_mm_movemask_epi8 (_mm_cmpeq_epi8 (a, b))) & 0xffff)
+          return pos + static_cast <size_t> (__builtin_ctz (mask));
+      }
+#endif
+      while (pos < len && key[pos] == tail[pos]) ++pos;
+      return pos;
+    }
+    ninfo& _info (const npos_t i) const { return _array[i].info (_ninfo, i); }
+    bool _has_ninfo () const { return FUSED || _ninfo; }
+    // labels of a dfa state to probe by base rather than walk siblings for
+    enum { MAX_PROBE = 16 };
+    template <typename T>
+    struct collector {
+      const da*    t;
+      T*           result;
+      size_t       result_len;
+      size_t       num;
+      void operator () (const value_type value, const size_t len, const npos_t to) {
+        if (num < result_len) t->_set_result (&result[num], value, len, to);
+        ++num;
+      }
+    };
+    // patternSearch () below from in dfa state s
+    template <typename F>
+    void _pattern (const dfa& d, F& f, const npos_t from, const size_t depth, int s) const {
+      const index_type base = _array[from].base;
+      if (base < 0) { // match the rest on _tail
+        const char* const tail = &_tail[-base];
+        size_t i = 0;
+        for (; tail[i]; ++i)
+          if ((s = d.next (s, static_cast <uchar> (tail[i]))) < 0) return;
+        if (! d.accept (s)) return;
+        npos_t to = from;
+        if (i) _set_tail (to, static_cast <npos_t> (-base) + i);
+        f (_value_of (_value_id (&tail[i + 1], from)), depth + i, to);
+        return;
+      }
+      const node& n = _array[base ^ 0];
+      if (from && d.accept (s) && n.check == static_cast <index_type> (from))
+        f (_value_of (_value_id (n)), depth, from);
+      if (d.num_labels (s) <= MAX_PROBE) {
+        const uchar* const label = d.labels (s);
+        for (int i = 0; i < d.num_labels (s); ++i) {
+          const npos_t to = static_cast <npos_t> (base ^ label[i]);
+          if (_array[to].check == static_cast <index_type> (from))
+            _pattern (d, f, to, depth + 1, d.next (s, label[i]));
+        }
+        return;
+      }
+      uchar c = _info (from).child;
+      if (! from || ! c) c = _info (base ^ c).sibling; // skip the terminal
+      for (; c; c = _info (base ^ c).sibling) {
+        const int t = d.next (s, c);
+        if (t >= 0) _pattern (d, f, static_cast <npos_t> (base ^ c), depth + 1, t);
+      }
+    }
+    // fuzzySearch () below from; row is the edit distance table of rows rows
+    template <typename T>
+    void _fuzzy (const char* key, const size_t len, const size_t max_distance, const npos_t from, const size_t depth, size_t*& row, size_t& rows, T* result, size_t* distance, const size_t result_len, size_t& num) {
+      const index_type base = _array[from].base;
+      if (base < 0) { // walk the suffix on _tail
+        const char* const tail = &_tail[-base] - depth;
+        size_t d = depth;
+        for (; tail[d]; ++d)
+          if (_fuzzy_row (key, len, max_distance, row, rows, d, static_cast <uchar> (tail[d])) > max_distance) return;
+        npos_t to = from;
+        if (d > depth) _set_tail (to, static_cast <npos_t> (-base) + (d - depth));
+        _fuzzy_result (result, distance, result_len, num, &row[d * (len + 1)], len, max_distance,
+                       _value_id (&tail[d + 1], from), to);
+        return;
+      }
+      const node& n = _array[base ^ 0];
+      if (from && n.check == static_cast <index_type> (from))
+        _fuzzy_result (result, distance, result_len, num, &row[depth * (len + 1)], len, max_distance,
+                       _value_id (n), from);
+      uchar c = _info (from).child;
+      if (! from || ! c) c = _info (base ^ c).sibling; // skip the terminal
+      for (; c; c = _info (base ^ c).sibling)
+        if (_fuzzy_row (key, len, max_distance, row, rows, depth, c) <= max_distance)
+          _fuzzy (key, len, max_distance, static_cast <npos_t> (base ^ c), depth + 1, row, rows, result, distance, result_len, num);
+    }
+    // the row at depth d + 1 from the row at d by byte c; return its minimum
+    size_t _fuzzy_row (const char* key, const size_t len, const size_t max_distance, size_t*& row, size_t& rows, const size_t d, const uchar c) {
+      if (d + 2 > rows) {
+        rows *= 2;
+        size_t* const row_ = static_cast <size_t*> (std::realloc (row, sizeof (size_t) * (len + 1) * rows));
+        if (! row_) _err (__FILE__, __LINE__, "memory allocation failed\n");
+        row = row_;
+      }
+      const size_t* const p = &row[d * (len + 1)];
+      size_t* const q = &row[(d + 1) * (len + 1)];
+      size_t m = q[0] = p[0] + 1;
+      size_t lo (1), hi (len);
+      if (max_distance < len) { // cells off the band [d + 1 - k, d + 1 + k] exceed k
+        if (d > max_distance) lo = d + 1 - max_distance;
+        if (lo > len) return m;
+        if (lo > 1) q[lo - 1] = max_distance + 1;
+        if (d + 1 + max_distance < len) hi = d + 1 + max_distance, q[hi + 1] = max_distance + 1;
+      }
+      for (size_t i = lo; i <= hi; ++i) {
+        size_t e = p[i - 1] + (static_cast <uchar> (key[i - 1]) != c);
+        if (e > p[i] + 1)     e = p[i] + 1;
+        if (e > q[i - 1] + 1) e = q[i - 1] + 1;
+        if ((q[i] = e) < m) m = e;
+      }
+      return m;
+    }
+    template <typename T>
+    void _fuzzy_result (T* result, size_t* distance, const size_t result_len, size_t& num, const size_t* row, const size_t len, const size_t max_distance, const index_type i, const npos_t to) const {
+      if (len - std::min (len, row[0]) > max_distance) return; // row[len] off the band
+      const size_t dist = row[len];
+      if (dist > max_distance) return;
+      if (num < result_len) {
+        _set_result (&result[num], _value_of (i), row[0], to);
+        if (distance) distance[num] = dist;
+      }
+      ++num;
     }
-#ifndef USE_FAST_LOAD
     void _restore_ninfo () {
       _realloc_array (_ninfo, _size);
-      for (int to = 0; to < _size; ++to) {
-        const int from = _array[to].check;
+      for (index_type to = 0; to < _size; ++to) {
+        const index_type from = _array[to].check;
         if (from < 0) continue; // skip empty node
-        const int base = _array[from].base;
+        const index_type base = _array[from].base;
         if (const uchar label = static_cast <uchar> (base ^ to)) // skip leaf
           _push_sibling (static_cast <size_t> (from), base, label,
-                         ! from || _ninfo[from].child || _array[base ^ 0].check == from);
+                         ! from || _info (from).child || _array[base ^ 0].check == from);
       }
     }
+    // rebuild _block from _array; as in _initialize (), block 0 keeps the
+    // root out of its empty nodes and stays off the Full/Closed/Open lists
     void _restore_block () {
       _realloc_array (_block, _size >> 8);
       _bheadF = _bheadC = _bheadO = 0;
-      for (int bi (0), e (0); e < _size; ++bi) { // register blocks to full
+      for (index_type bi (0), e (1); e < _size; ++bi) { // register blocks to full
         block& b = _block[bi];
-        b.num = 0;
+        b.num = bi ? 0 : 1; // the special block counts the root as in _initialize ()
         for (; e < (bi << 8) + 256; ++e)
-          if (_array[e].check < 0 && ++b.num == 1) b.ehead = e;
-        int& head_out = b.num == 1 ? _bheadC : (b.num == 0 ? _bheadF : _bheadO);
+          if (_array[e].check < 0 && ++b.num == 1 + ! bi) b.ehead = e;
+        if (! bi) continue; // never register the special block
+        index_type& head_out = b.num == 1 ? _bheadC : (b.num == 0 ? _bheadF : _bheadO);
         _push_block (bi, head_out, ! head_out && b.num);
       }
     }
-#endif
     void _set_result (result_type* x, value_type r, size_t = 0, npos_t = 0) const
     { *x = r; }
     void _set_result (result_pair_type* x, value_type r, size_t l, npos_t = 0) const
     { x->value = r; x->length = l; }
     void _set_result (result_triple_type* x, value_type r, size_t l, npos_t from) const
     { x->value = r; x->length = l; x->id = from; }
-    void _pop_block (const int bi, int& head_in, const bool last) {
+    void _pop_block (const index_type bi, index_type& head_in, const bool last) {
       if (last) { // last one poped; Closed or Open
         head_in = 0;
       } else {
@@ -627,31 +2430,35 @@ namespace cedar {
         if (bi == head_in) head_in = b.next;
       }
     }
-    void _push_block (const int bi, int& head_out, const bool empty) {
+    void _push_block (const index_type bi, index_type& head_out, const bool empty) {
       block& b = _block[bi];
       if (empty) { // the destination is empty
         head_out = b.prev = b.next = bi;
       } else { // use most recently pushed
-        int& tail_out = _block[head_out].prev;
+        index_type& tail_out = _block[head_out].prev;
         b.prev = tail_out;
         b.next = head_out;
         head_out = tail_out = _block[tail_out].next = bi;
       }
     }
-    int _add_block () {
+    index_type _add_block () {
       if (_size == _capacity) { // allocate memory if needed
 #ifdef USE_EXACT_FIT
         _capacity += _size >= MAX_ALLOC_SIZE ? MAX_ALLOC_SIZE : _size;
 #else
         _capacity += _capacity;
 #endif
+        CEDAR_STAT (_stats.realloc += FUSED ? 2 : 3); // _array, _ninfo and _block
+        CEDAR_STAT (_stats.realloc_bytes += (sizeof (node) + (FUSED ? 0 : sizeof (ninfo))) * static_cast <size_t> (_size)
+                                         + sizeof (block) * static_cast <size_t> (_size >> 8));
         _realloc_array (_array, _capacity, _capacity);
-        _realloc_array (_ninfo, _capacity, _size);
+        if (! FUSED) _realloc_array (_ninfo, _capacity, _size);
         _realloc_array (_block, _capacity >> 8, _size >> 8);
       }
+      CEDAR_STAT (++_stats.add_block);
       _block[_size >> 8].ehead = _size;
       _array[_size] = node (- (_size + 255),  - (_size + 1));
-      for (int i = _size + 1; i < _size + 255; ++i)
+      for (index_type i = _size + 1; i < _size + 255; ++i)
         _array[i] = node (-(i - 1), -(i + 1));
       _array[_size + 255] = node (- (_size + 254),  -_size);
       _push_block (_size >> 8, _bheadO, ! _bheadO); // append to block Open
@@ -659,14 +2466,17 @@ namespace cedar {
       return (_size >> 8) - 1;
     }
     // transfer block from one start w/ head_in to one start w/ head_out
-    void _transfer_block (const int bi, int& head_in, int& head_out) {
+    void _transfer_block (const index_type bi, index_type& head_in, index_type& head_out) {
+      CEDAR_STAT (++_stats.transfer[_block_list (head_in)][_block_list (head_out)]);
       _pop_block  (bi, head_in, bi == _block[bi].next);
       _push_block (bi, head_out, ! head_out && _block[bi].num);
     }
+    block_list _block_list (const index_type& head) const
+    { return &head == &_bheadF ? BLOCK_FULL : &head == &_bheadC ? BLOCK_CLOSED : BLOCK_OPEN; }
     // pop empty node from block; never transfer the special block (bi = 0)
-    int _pop_enode (const int base, const uchar label, const int from) {
-      const int e  = base < 0 ? _find_place () : base ^ label;
-      const int bi = e >> 8;
+    index_type _pop_enode (const index_type base, const uchar label, const index_type from) {
+      const index_type e  = base < 0 ? _find_place () : base ^ label;
+      const index_type bi = e >> 8;
       node&  n = _array[e];
       block& b = _block[bi];
       if (--b.num == 0) {
@@ -679,22 +2489,23 @@ namespace cedar {
           _transfer_block (bi, _bheadO, _bheadC);
       }
       // initialize the released node
-      if (label) n.base = -1; else n.value = value_type (0);
+      if (label) n.base = -1; else n.value = slot_type (0);
       n.check = from;
+      ++_num_nodes;
       if (base < 0) _array[from].base = e ^ label;
       return e;
     }
     // push empty node into empty ring
-    void _push_enode (const int e) {
-      const int bi = e >> 8;
+    void _push_enode (const index_type e) {
+      const index_type bi = e >> 8;
       block& b = _block[bi];
       if (++b.num == 1) { // Full to Closed
         b.ehead = e;
         _array[e] = node (-e, -e);
         if (bi) _transfer_block (bi, _bheadF, _bheadC); // Full to Closed
       } else {
-        const int prev = b.ehead;
-        const int next = -_array[prev].check;
+        const index_type prev = b.ehead;
+        const index_type next = -_array[prev].check;
         _array[e] = node (-prev, -next);
         _array[prev].check = _array[next].base = -e;
         if (b.num == 2 || b.trial == MAX_TRIAL) { // Closed to Open
@@ -703,113 +2514,137 @@ namespace cedar {
         b.trial = 0;
       }
       if (b.reject < _reject[b.num]) b.reject = _reject[b.num];
-      _ninfo[e] = ninfo (); // reset ninfo; no child, no sibling
+      _info (e) = ninfo (); // reset ninfo; no child, no sibling
+      --_num_nodes;
     }
     // push label to from's child
-    void _push_sibling (const npos_t from, const int base, const uchar label, const bool flag = true) {
-      uchar* c = &_ninfo[from].child;
+    void _push_sibling (const npos_t from, const index_type base, const uchar label, const bool flag = true) {
+      uchar* c = &_info (from).child;
       if (flag && (ORDERED ? label > *c : ! *c))
-        do c = &_ninfo[base ^ *c].sibling; while (ORDERED && *c && *c < label);
-      _ninfo[base ^ label].sibling = *c, *c = label;
+        do c = &_info (base ^ *c).sibling; while (ORDERED && *c && *c < label);
+      _info (base ^ label).sibling = *c, *c = label;
     }
     // pop label from from's child
-    void _pop_sibling (const npos_t from, const int base, const uchar label) {
-      uchar* c = &_ninfo[from].child;
-      while (*c != label) c = &_ninfo[base ^ *c].sibling;
-      *c = _ninfo[base ^ label].sibling;
+    void _pop_sibling (const npos_t from, const index_type base, const uchar label) {
+      uchar* c = &_info (from).child;
+      while (*c != label) c = &_info (base ^ *c).sibling;
+      *c = _info (base ^ label).sibling;
     }
     // check whether to replace branching w/ the newly added node
-    bool _consult (const int base_n, const int base_p, uchar c_n, uchar c_p) const {
-      do c_n = _ninfo[base_n ^ c_n].sibling, c_p = _ninfo[base_p ^ c_p].sibling;
+    bool _consult (const index_type base_n, const index_type base_p, uchar c_n, uchar c_p) const {
+      do c_n = _info (base_n ^ c_n).sibling, c_p = _info (base_p ^ c_p).sibling;
       while (c_n && c_p);
       return c_p;
     }
     // enumerate (equal to or more than one) child nodes
-    uchar* _set_child (uchar* p, const int base, uchar c, const int label = -1) {
+    uchar* _set_child (uchar* p, const index_type base, uchar c, const int label = -1) {
       --p;
-      if (! c)  { *++p = c; c = _ninfo[base ^ c].sibling; } // 0: terminal
+      if (! c)  { *++p = c; c = _info (base ^ c).sibling; } // 0: terminal
       if (ORDERED)
-        while (c && c < label) { *++p = c; c = _ninfo[base ^ c].sibling; }
+        while (c && c < label) { *++p = c; c = _info (base ^ c).sibling; }
       if (label != -1) *++p = static_cast <uchar> (label);
-      while (c) { *++p = c; c = _ninfo[base ^ c].sibling; }
+      while (c) { *++p = c; c = _info (base ^ c).sibling; }
       return p;
     }
     // explore new block to settle down
-    int _find_place () {
+    index_type _find_place () {
       if (_bheadC) return _block[_bheadC].ehead;
       if (_bheadO) return _block[_bheadO].ehead;
       return _add_block () << 8;
     }
-    int _find_place (const uchar* const first, const uchar* const last) {
-      if (int bi = _bheadO) {
-        const int   bz = _block[_bheadO].prev;
+    index_type _find_place (const uchar* const first, const uchar* const last) {
+      if (index_type bi = _bheadO) {
+        const index_type   bz = _block[_bheadO].prev;
         const short nc = static_cast <short> (last - first + 1);
         while (1) { // set candidate block
           block& b = _block[bi];
+          CEDAR_STAT (++_stats.block_scans);
           if (b.num >= nc && nc < b.reject) // explore configuration
-            for (int e = b.ehead;;) {
-              const int base = e ^ *first;
+            for (index_type e = b.ehead;;) {
+              const index_type base = e ^ *first;
               for (const uchar* p = first; _array[base ^ *++p].check < 0; )
                 if (p == last) return b.ehead = e; // no conflict
               if ((e = -_array[e].check) == b.ehead) break;
             }
           b.reject = nc;
           if (b.reject < _reject[b.num]) _reject[b.num] = b.reject;
-          const int bi_ = b.next;
-          if (++b.trial == MAX_TRIAL) _transfer_block (bi, _bheadO, _bheadC);
+          const index_type bi_ = b.next;
+          if (++b.trial == MAX_TRIAL) {
+            CEDAR_STAT (++_stats.trial_exhausted);
+            _transfer_block (bi, _bheadO, _bheadC);
+          }
           if (bi == bz) break;
           bi = bi_;
         }
       }
       return _add_block () << 8;
     }
+    // first-fit over the last few blocks, which keeps bulk-loaded arrays dense
+    index_type _find_place_bulk (const uchar* const first, const uchar* const last) {
+      const int nc = static_cast <int> (last - first + 1);
+      for (index_type bi = (_size >> 8) > 16 ? (_size >> 8) - 16 : 1; bi < (_size >> 8); ++bi) {
+        const block& b = _block[bi];
+        CEDAR_STAT (++_stats.block_scans);
+        if (b.num < nc) continue;
+        for (index_type e = b.ehead;;) {
+          const index_type base = e ^ *first;
+          const uchar* p = first;
+          while (++p <= last && _array[base ^ *p].check < 0) ;
+          if (p > last) return e; // no conflict
+          if ((e = -_array[e].check) == b.ehead) break;
+        }
+      }
+      return _add_block () << 8;
+    }
     // resolve conflict on base_n ^ label_n = base_p ^ label_p
     template <typename T>
-    int _resolve (npos_t& from_n, const int base_n, const uchar label_n, T& cf) {
+    index_type _resolve (npos_t& from_n, const index_type base_n, const uchar label_n, T& cf) {
       // examine siblings of conflicted nodes
-      const int to_pn  = base_n ^ label_n;
-      const int from_p = _array[to_pn].check;
-      const int base_p = _array[from_p].base;
+      CEDAR_STAT (++_stats.resolve);
+      const index_type to_pn  = base_n ^ label_n;
+      const index_type from_p = _array[to_pn].check;
+      const index_type base_p = _array[from_p].base;
       const bool flag // whether to replace siblings of newly added
-        = _consult (base_n, base_p, _ninfo[from_n].child, _ninfo[from_p].child);
+        = _consult (base_n, base_p, _info (from_n).child, _info (from_p).child);
       uchar child[256];
       uchar* const first = &child[0];
       uchar* const last  =
-        flag ? _set_child (first, base_n, _ninfo[from_n].child, label_n)
-        : _set_child (first, base_p, _ninfo[from_p].child);
-      const int base =
+        flag ? _set_child (first, base_n, _info (from_n).child, label_n)
+        : _set_child (first, base_p, _info (from_p).child);
+      const index_type base =
         (first == last ? _find_place () : _find_place (first, last)) ^ *first;
       // replace & modify empty list
-      const int from  = flag ? static_cast <int> (from_n) : from_p;
-      const int base_ = flag ? base_n : base_p;
-      if (flag && *first == label_n) _ninfo[from].child = label_n; // new child
+      const index_type from  = flag ? static_cast <index_type> (from_n) : from_p;
+      const index_type base_ = flag ? base_n : base_p;
+      if (flag && *first == label_n) _info (from).child = label_n; // new child
       _array[from].base = base; // new base
       for (const uchar* p = first; p <= last; ++p) { // to_ => to
-        const int to  = _pop_enode (base, *p, from);
-        const int to_ = base_ ^ *p;
-        _ninfo[to].sibling = (p == last ? 0 : *(p + 1));
+        const index_type to  = _pop_enode (base, *p, from);
+        const index_type to_ = base_ ^ *p;
+        _info (to).sibling = (p == last ? 0 : *(p + 1));
         if (flag && to_ == to_pn) continue; // skip newcomer (no child)
+        CEDAR_STAT (++_stats.relocated);
         cf (to_, to);
         node& n  = _array[to];
         node& n_ = _array[to_];
         if ((n.base = n_.base) > 0 && *p) { // copy base; bug fix
-          uchar c = _ninfo[to].child = _ninfo[to_].child;
+          uchar c = _info (to).child = _info (to_).child;
           do _array[n.base ^ c].check = to; // adjust grand son's check
-          while ((c = _ninfo[n.base ^ c].sibling));
+          while ((c = _info (n.base ^ c).sibling));
         }
-        if (! flag && to_ == static_cast <int> (from_n)) // parent node moved
+        if (! flag && to_ == static_cast <index_type> (from_n)) // parent node moved
           from_n = static_cast <size_t> (to); // bug fix
         if (! flag && to_ == to_pn) { // the address is immediately used
           _push_sibling (from_n, to_pn ^ label_n, label_n);
-          _ninfo[to_].child = 0; // remember to reset child
-          if (label_n) n_.base = -1; else n_.value = value_type (0);
-          n_.check = static_cast <int> (from_n);
+          _info (to_).child = 0; // remember to reset child
+          if (label_n) n_.base = -1; else n_.value = slot_type (0);
+          n_.check = static_cast <index_type> (from_n);
         } else
           _push_enode (to_);
         if (NUM_TRACKING_NODES) // keep the traversed node updated
           for (size_t j = 0; tracking_node[j] != 0; ++j) {
-            if (static_cast <int> (tracking_node[j] & TAIL_OFFSET_MASK) == to_) {
-              tracking_node[j] &= NODE_INDEX_MASK;
+            if (static_cast <index_type> (_node_of (tracking_node[j])) == to_) {
+              tracking_node[j] >>= NODE_BITS, tracking_node[j] <<= NODE_BITS;
               tracking_node[j] |= static_cast <npos_t> (to);
             }
           }
@@ -818,17 +2653,619 @@ namespace cedar {
     }
     // test the validity of double array for debug
     void _test (const npos_t from = 0) const {
-      const int base = _array[from].base;
+      const index_type base = _array[from].base;
       if (base < 0) { // validate tail offset
-        assert (*_length >= static_cast <int> (-base + 1 + sizeof (value_type)));
+        assert (*_length >= static_cast <index_type> (-base + 1 + sizeof (value_type)));
         return;
       }
-      uchar c = _ninfo[from].child;
+      uchar c = _info (from).child;
       do {
-        if (from) assert (_array[base ^ c].check == static_cast <int> (from));
+        if (from) assert (_array[base ^ c].check == static_cast <index_type> (from));
         if (c) _test (static_cast <npos_t> (base ^ c));
-      } while ((c = _ninfo[base ^ c].sibling));
+      } while ((c = _info (base ^ c).sibling));
+    }
+  };
+  // Aho-Corasick automaton over a trie to find every key in a text in one
+  // pass; a state is a node or a position in a suffix on _tail, with its
+  // depth, failure link and output link (the nearest state on the failure
+  // chain that ends a key, itself included).  the trie must not be updated
+  // while the automaton is in use (see stale ()), nor have a shared _tail
+  template <typename trie_t>
+  class aho_corasick {
+  public:
+    typedef typename trie_t::result_type value_type;
+    typedef typename trie_t::node_index  index_type;
+    struct match_type {
+      size_t     start;  // from the head of the text, across chunks
+      size_t     length;
+      value_type value;
+    };
+    struct cursor { // where a scan stopped; pass it again for the next chunk
+      index_type state;
+      size_t     offset; // bytes scanned so far
+      cursor () : state (0), offset (0) {}
+    };
+    explicit aho_corasick (const trie_t& t) : _t (t), _link (0), _num_states (0) {
+      try { _build (); } catch (...) { std::free (_link); throw; }
+    }
+    ~aho_corasick () { std::free (_link); }
+    size_t num_states () const { return static_cast <size_t> (_num_states); }
+    size_t total_size () const { return sizeof (link) * static_cast <size_t> (_num_states); }
+    // whether the trie has changed since the automaton was built
+    bool stale () const { return _t._revision != _revision; }
+    // call f (start, length, value) for each key found, by the end position
+    // and then from the longest
+    template <typename T>
+    void scan (const char* text, const size_t len, cursor& c, T& f) const {
+      const uchar* const text_ = reinterpret_cast <const uchar*> (text);
+      index_type s = c.state;
+      for (size_t i = 0; i < len; ++i) {
+        index_type t;
+        while ((t = _next (s, text_[i])) < 0 && s) s = _link[s].fail;
+        s = t < 0 ? 0 : t;
+        for (index_type e = _link[s].out; e; e = _link[e].next) {
+          const size_t l = static_cast <size_t> (_link[e].depth);
+          f (c.offset + i + 1 - l, l, _value_of (e));
+        }
+      }
+      c.state = s;
+      c.offset += len;
+    }
+    // store up to result_len matches and return the number of matches
+    size_t scan (const char* text, const size_t len, match_type* result, const size_t result_len, cursor& c) const {
+      collector f = { result, result_len, 0 };
+      scan (text, len, c, f);
+      return f.num;
+    }
+    size_t scan (const char* text, const size_t len, match_type* result, const size_t result_len) const
+    { cursor c; return scan (text, len, result, result_len, c); }
+  private:
+    aho_corasick (const aho_corasick&);
+    aho_corasick& operator= (const aho_corasick&);
+    struct collector {
+      match_type* result;
+      size_t      result_len;
+      size_t      num;
+      void operator () (const size_t start, const size_t length, const value_type value) {
+        if (num < result_len) {
+          match_type& m = result[num];
+          m.start = start, m.length = length, m.value = value;
+        }
+        ++num;
+      }
+    };
+    struct link {
+      index_type fail;
+      index_type out;   // 0 if none
+      index_type next;  // out of the failure link
+      index_type depth; // -1 if not a state
+    };
+    const trie_t& _t;
+    link*       _link;
+    index_type  _num_states; // nodes, then bytes of _tail
+    size_t      _revision;   // to tell stale ()
+    const char* _tail;
+    index_type  _size;
+    index_type  _length;
+    template <typename T>
+    static T* _alloc (const index_type n) {
+      T* const p = static_cast <T*> (std::malloc (sizeof (T) * static_cast <size_t> (n)));
+      if (! p) throw std::runtime_error ("memory allocation failed");
+      return p;
+    }
+    // goto function; a leaf goes to the head of its suffix
+    index_type _next (const index_type s, const uchar c) const {
+      if (! c) return -1;
+      if (s >= _size) return _tail[s - _size] == static_cast <char> (c) ? s + 1 : -1;
+      const index_type to = _t._array[s].base ^ c;
+      if (_t._array[to].check != s) return -1;
+      const index_type base = _t._array[to].base;
+      return base >= 0 ? to : _size - base;
+    }
+    bool _ends (const index_type s) const {
+      if (s >= _size) return ! _tail[s - _size];
+      return s && _t._array[_t._array[s].base ^ 0].check == s;
+    }
+    value_type _value_of (const index_type s) const {
+      if (s >= _size) return _t._value_of (_t._value_id (&_tail[s - _size + 1]));
+      return _t._value_of (_t._value_id (_t._array[_t._array[s].base ^ 0]));
+    }
+    // depths of nodes, then links by breadth-first order of states, where
+    // a suffix on _tail stands for its leaf
+    void _build () {
+      if (_t._leaf) throw std::runtime_error ("shared _tail is not supported");
+      _revision = _t._revision, _tail = _t._tail, _size = _t._size, _length = *_t._length;
+      _num_states = _size + _length;
+      _link = _alloc <link> (_num_states);
+      const typename trie_t::node* const array = _t._array;
+      for (index_type i = 0; i < _num_states; ++i) _link[i].depth = -1;
+      _link[0].depth = 0;
+      index_type max_depth = 0;
+      for (index_type to = 1; to < _size; ++to) {
+        if (array[to].check < 0 || _link[to].depth >= 0) continue;
+        index_type d = 0, p = to;
+        for (; _link[p].depth < 0; p = array[p].check) ++d;
+        d += _link[p].depth;
+        if (d > max_depth) max_depth = d;
+        for (p = to; _link[p].depth < 0; p = array[p].check) _link[p].depth = d--;
+      }
+      for (index_type to = 1; to < _size; ++to) // suffixes on _tail
+        if (array[to].check >= 0 && array[to].base < 0 && array[array[to].check].base != to) {
+          index_type o = _size - array[to].base, d = _link[to].depth;
+          for (_link[o].depth = d; _tail[o - _size]; _link[o].depth = d) ++o, ++d;
+          if (d > max_depth) max_depth = d;
+        }
+      // sort states but the root by depth; the head of a suffix by its leaf
+      index_type* const order = _alloc <index_type> (_num_states + max_depth + 2);
+      index_type* const count = order + _num_states;
+      for (index_type d = 0; d <= max_depth + 1; ++d) count[d] = 0;
+      for (index_type s = 0; s < _num_states; ++s)
+        if (_in_order (s)) ++count[_link[s].depth];
+      for (index_type d = 1; d <= max_depth + 1; ++d) count[d] += count[d - 1];
+      for (index_type s = _num_states - 1; s >= 0; --s)
+        if (_in_order (s)) order[--count[_link[s].depth]] = s;
+      const index_type n = count[max_depth + 1];
+      _link[0].fail = _link[0].out = _link[0].next = 0;
+      for (index_type i = 0; i < n; ++i) {
+        index_type t = order[i], s;
+        uchar c;
+        if (t < _size) { // a node; the head of a suffix if a leaf
+          s = array[t].check;
+          c = static_cast <uchar> (array[s].base ^ t);
+          if (array[t].base < 0) t = _size - array[t].base;
+        } else
+          s = t - 1, c = static_cast <uchar> (_tail[s - _size]);
+        index_type f = 0;
+        if (s) // follow failure links of the parent
+          for (index_type g = _link[s].fail; ; g = _link[g].fail) {
+            const index_type h = _next (g, c);
+            if (h >= 0) { f = h; break; }
+            if (! g) break;
+          }
+        _link[t].fail = f;
+        _link[t].next = _link[f].out;
+        _link[t].out  = _ends (t) ? t : _link[t].next;
+      }
+      std::free (order);
+    }
+    // a node but the root and terminals, with a leaf standing for the head
+    // of its suffix, or a later position in a suffix
+    bool _in_order (const index_type s) const {
+      if (s >= _size) return s > _size && _link[s].depth > 0 && _link[s - 1].depth >= 0;
+      const typename trie_t::node& n = _t._array[s];
+      return s && n.check >= 0 && _t._array[n.check].base != s;
+    }
+  };
+  // keys following a prefix with the largest values, best first; each node
+  // keeps the largest value below it and its children in descending order
+  // of that, so that a search takes the best branch left and stops after k
+  // keys, visiting O(k * depth) nodes whatever the size of the subtree.
+  // the trie must not be updated while the index is in use (see stale (),
+  // which can not tell a value changed through a reference kept from an
+  // earlier update ())
+  template <typename trie_t>
+  class top_k {
+  public:
+    typedef typename trie_t::result_type value_type;
+    typedef typename trie_t::node_index  index_type;
+    explicit top_k (const trie_t& t) : _t (t), _rank (0) {
+      try { _build (); } catch (...) { std::free (_rank); throw; }
+    }
+    ~top_k () { std::free (_rank); }
+    size_t total_size () const { return sizeof (rank) * static_cast <size_t> (_size); }
+    // whether the trie has changed since the index was built
+    bool stale () const { return _t._revision != _revision; }
+    // store up to k keys following key by descending value, as
+    // commonPrefixPredict () does, and return the number of keys stored;
+    // keys of the same value come in no particular order
+    template <typename T>
+    size_t topKPredict (const char* key, T* result, const size_t k) const
+    { return topKPredict (key, result, k, std::strlen (key)); }
+    template <typename T>
+    size_t topKPredict (const char* key, T* result, const size_t k, const size_t len, npos_t from = 0) const {
+      size_t pos = 0;
+      if (! k || _t._find (key, from, pos, len) == trie_t::CEDAR_NO_PATH) return 0;
+      const typename trie_t::node* const array = _t._array;
+      const npos_t to = trie_t::_node_of (from);
+      if (from != to || array[to].base < 0) { // the one key on _tail
+        const size_t offset = from != to ? _t._tail_of (from) : static_cast <size_t> (-array[to].base);
+        const size_t n = std::strlen (&_tail[offset]);
+        if (n) _t._set_tail (from, offset + n);
+        _t._set_result (result, _t._value_of (_t._value_id (&_tail[offset + n + 1], to)), n, from);
+        return 1;
+      }
+      size_t num = 0, size = 0, capacity = 64;
+      entry* heap = _alloc <entry> (capacity);
+      if (const index_type c = _rank[to].first) heap[size++] = _entry (c, _rank[to].best, 0);
+      while (size && num < k) {
+        std::pop_heap (heap, heap + size, entry ());
+        const entry e = heap[--size];
+        if (size + 2 > capacity) {
+          entry* const p = static_cast <entry*> (std::realloc (heap, sizeof (entry) * (capacity <<= 1)));
+          if (! p) { std::free (heap); throw std::runtime_error ("memory allocation failed"); }
+          heap = p;
+        }
+        const rank& r = _rank[e.to];
+        if (r.next) {
+          heap[size++] = _entry (r.next, _rank[r.next].best, e.depth);
+          std::push_heap (heap, heap + size, entry ());
+        }
+        if (r.first) { // the first child has the same best
+          heap[size++] = _entry (r.first, r.best, e.depth + 1);
+          std::push_heap (heap, heap + size, entry ());
+          continue;
+        }
+        const typename trie_t::node& n = array[e.to];
+        const npos_t parent = static_cast <npos_t> (n.check);
+        if (array[parent].base == e.to) // terminal
+          _t._set_result (&result[num++], _t._value_of (_t._value_id (n)), e.depth, parent);
+        else { // leaf; the rest of the key on _tail
+          const char* const tail = &_tail[-n.base];
+          const size_t m = std::strlen (tail);
+          npos_t id = static_cast <npos_t> (e.to);
+          if (m) _t._set_tail (id, static_cast <size_t> (-n.base) + m);
+          _t._set_result (&result[num++], _t._value_of (_t._value_id (&tail[m + 1], e.to)), e.depth + 1 + m, id);
+        }
+      }
+      std::free (heap);
+      return num;
+    }
+  private:
+    top_k (const top_k&);
+    top_k& operator= (const top_k&);
+    struct rank {
+      value_type best;  // the largest value of keys below
+      index_type first; // the child of the largest best; 0 if none
+      index_type next;  // the sibling of the next largest best; 0 if none
+    };
+    struct entry { // a node to visit, ordered by best
+      value_type best;
+      index_type to;
+      size_t     depth; // the length of the key up to its parent
+      bool operator () (const entry& a, const entry& b) const { return a.best < b.best; }
+    };
+    // nodes by descending best and then label
+    struct by_best {
+      const rank* r;
+      const typename trie_t::node* array;
+      bool operator () (const index_type a, const index_type b) const {
+        if (r[a].best < r[b].best || r[b].best < r[a].best) return r[b].best < r[a].best;
+        return (array[array[a].check].base ^ a) < (array[array[b].check].base ^ b);
+      }
+    };
+    const trie_t& _t;
+    rank*       _rank;
+    size_t      _revision; // to tell stale ()
+    const char* _tail;
+    index_type  _size;
+    template <typename T>
+    static T* _alloc (const size_t n) {
+      T* const p = static_cast <T*> (std::malloc (sizeof (T) * n));
+      if (! p) throw std::runtime_error ("memory allocation failed");
+      return p;
+    }
+    static entry _entry (const index_type to, const value_type best, const size_t depth) {
+      const entry e = { best, to, depth };
+      return e;
+    }
+    // raise best from each key up to the root, until an ancestor holds a
+    // larger one, and then link children in descending order of best
+    void _build () {
+      _revision = _t._revision, _tail = _t._tail, _size = _t._size;
+      _rank = _alloc <rank> (static_cast <size_t> (_size));
+      const typename trie_t::node* const array = _t._array;
+      for (index_type i = 0; i < _size; ++i) _rank[i].first = _rank[i].next = 0;
+      index_type num = 0; // nodes but the root
+      for (index_type to = 1; to < _size; ++to) {
+        const typename trie_t::node& n = array[to];
+        if (n.check < 0) continue;
+        ++num;
+        value_type v;
+        if (array[n.check].base == to) // terminal
+          v = _t._value_of (_t._value_id (n));
+        else if (n.base < 0) { // leaf
+          const char* const tail = &_tail[-n.base];
+          v = _t._value_of (_t._value_id (tail + std::strlen (tail) + 1, static_cast <npos_t> (to)));
+        } else continue;
+        for (index_type p = to; ; p = array[p].check) { // next marks a node with best
+          rank& r = _rank[p];
+          if (r.next && ! (r.best < v)) break;
+          r.best = v, r.next = 1;
+          if (! p) break;
+        }
+      }
+      // group nodes by parent, counted in first, and sort each group
+      index_type* const order = _alloc <index_type> (static_cast <size_t> (num));
+      for (index_type i = 0; i < _size; ++i) _rank[i].next = 0;
+      for (index_type to = 1; to < _size; ++to)
+        if (array[to].check >= 0) ++_rank[array[to].check].first;
+      for (index_type p = 0, offset = 0; p < _size; ++p) {
+        const index_type n = _rank[p].first;
+        _rank[p].first = offset, offset += n;
+      }
+      for (index_type to = 1; to < _size; ++to)
+        if (array[to].check >= 0) {
+          rank& r = _rank[array[to].check];
+          order[r.first + r.next++] = to;
+        }
+      const by_best f = { _rank, array };
+      for (index_type p = 0; p < _size; ++p) {
+        const index_type head = _rank[p].first, tail = p + 1 < _size ? _rank[p + 1].first : num;
+        if (head == tail) { _rank[p].first = 0; continue; }
+        std::sort (order + head, order + tail, f);
+        _rank[p].first = order[head];
+        for (index_type i = head; i < tail; ++i)
+          _rank[order[i]].next = i + 1 < tail ? order[i + 1] : 0;
+      }
+      std::free (order);
+    }
+  };
+#if __cplusplus >= 201103L
+  // a trie updated by one writer at a time and searched by many readers
+  // without locks (left-right): the writer keeps two copies, updates the
+  // one that readers have left, turns new readers to it, waits for readers
+  // still on the other to leave, and applies the update there too.  readers
+  // never wait or retry and never see an update in progress, while growth
+  // and relocations by _resolve () only touch the copy nobody reads; this
+  // costs twice the memory and applying each update twice
+  template <typename trie_t, const size_t NUM_SLOTS = 64>
+  class concurrent_da {
+  public:
+    typedef typename trie_t::result_type       value_type;
+    typedef typename trie_t::result_type       result_type;
+    typedef typename trie_t::result_pair_type  result_pair_type;
+    enum error_code { CEDAR_NO_VALUE = trie_t::CEDAR_NO_VALUE, CEDAR_NO_PATH = trie_t::CEDAR_NO_PATH };
+    concurrent_da () : _trie (), _active (0), _version (0), _slot (), _mutex () {}
+    // writer
+    value_type update (const char* key, size_t len, value_type val = value_type (0))
+    { return _write ([&] (trie_t& t) -> value_type { return t.update (key, len, val); }); }
+    int erase (const char* key, size_t len)
+    { return _write ([&] (trie_t& t) { return t.erase (key, len); }); }
+    bool collect_tail (const double ratio = 0.5)
+    { return _write ([&] (trie_t& t) { return t.collect_tail (ratio); }); }
+    size_t num_keys () const { const reader r (*this); return r.trie.num_keys (); }
+    // readers
+    template <typename T>
+    T exactMatchSearch (const char* key, size_t len) const {
+      const reader r (*this);
+      return r.trie.template exactMatchSearch <T> (key, len);
+    }
+    template <typename T>
+    size_t commonPrefixSearch (const char* key, T* result, size_t result_len, size_t len) const {
+      const reader r (*this);
+      return r.trie.commonPrefixSearch (key, result, result_len, len);
+    }
+  private:
+    concurrent_da (const concurrent_da&);
+    concurrent_da& operator= (const concurrent_da&);
+    struct alignas (64) slot { // readers in progress by version; threads share slots by hash
+      std::atomic <size_t> count[2];
+      slot () { count[0] = count[1] = 0; }
+    };
+    struct reader { // count in a slot of the current version while reading the active copy
+      std::atomic <size_t>& count;
+      const trie_t&         trie;
+      explicit reader (const concurrent_da& d) : count (d._arrive ()), trie (d._trie[d._active.load ()]) {}
+      ~reader () { count.fetch_sub (1); }
+    };
+    trie_t                 _trie[2];
+    std::atomic <int>      _active;  // copy for new readers
+    std::atomic <int>      _version; // counts for new readers
+    mutable slot           _slot[NUM_SLOTS];
+    std::mutex             _mutex;
+    //
+    std::atomic <size_t>& _arrive () const {
+      static thread_local const size_t i
+        = std::hash <std::thread::id> () (std::this_thread::get_id ()) % NUM_SLOTS;
+      std::atomic <size_t>& count = _slot[i].count[_version.load ()];
+      count.fetch_add (1);
+      return count;
+    }
+    // update the inactive copy, switch readers to it, and then the other
+    template <typename F>
+    auto _write (F f) -> decltype (f (_trie[0])) {
+      std::lock_guard <std::mutex> lock (_mutex);
+      const int i = _active.load ();
+      f (_trie[1 - i]); // left by readers at the last _write ()
+      _active.store (1 - i);
+      const int v = _version.load (); // see that readers of _trie[i] have left
+      _drain (1 - v);
+      _version.store (1 - v);
+      _drain (v);
+      return f (_trie[i]);
+    }
+    void _drain (const int v) const {
+      for (size_t i = 0; i < NUM_SLOTS; ++i)
+        while (_slot[i].count[v].load ()) std::this_thread::yield ();
     }
   };
+  // shards of tries selected by the first PREFIX_LEN bytes of a key, each
+  // behind its own lock; keys shorter than PREFIX_LEN are selected by the
+  // whole key, so prefix search visits a shard for each such prefix
+  template <typename trie_t, const size_t NUM_SHARDS = 16, const size_t PREFIX_LEN = 2>
+  class sharded_da {
+  public:
+    typedef typename trie_t::result_type       value_type;
+    typedef typename trie_t::result_type       result_type;
+    typedef typename trie_t::result_pair_type  result_pair_type;
+    struct result_triple_type { // for predict ()
+      value_type  value;
+      size_t      length;  // suffix length
+      npos_t      id;      // node id of value
+      size_t      shard;   // shard of id
+    };
+    typedef typename trie_t::node_index        index_type;
+    struct cursor { // position of ordered iteration over all shards
+      npos_t       from[NUM_SHARDS];
+      size_t       len[NUM_SHARDS];
+      index_type   value[NUM_SHARDS]; // value id; CEDAR_NO_PATH if exhausted
+      std::string  key[NUM_SHARDS];
+      size_t       shard;             // shard of the current key
+    };
+    enum error_code { CEDAR_NO_VALUE = trie_t::CEDAR_NO_VALUE, CEDAR_NO_PATH = trie_t::CEDAR_NO_PATH };
+    sharded_da () : _shard () {}
+    trie_t&       shard (const size_t i)       { return _shard[i].trie; }
+    const trie_t& shard (const size_t i) const { return _shard[i].trie; }
+    static size_t shard_of (const char* key, const size_t len) {
+      npos_t h = 14695981039346656037ULL; // FNV-1a
+      for (size_t i = 0; i < len && i < PREFIX_LEN; ++i)
+        h = (h ^ static_cast <uchar> (key[i])) * 1099511628211ULL;
+      return static_cast <size_t> (h % NUM_SHARDS);
+    }
+    size_t num_keys () const {
+      size_t n = 0;
+      for (size_t i = 0; i < NUM_SHARDS; ++i)
+        { std::lock_guard <std::mutex> lock (_shard[i].mutex); n += _shard[i].trie.num_keys (); }
+      return n;
+    }
+    size_t total_size () const {
+      size_t n = 0;
+      for (size_t i = 0; i < NUM_SHARDS; ++i)
+        { std::lock_guard <std::mutex> lock (_shard[i].mutex); n += _shard[i].trie.total_size (); }
+      return n;
+    }
+    // interface
+    value_type update (const char* key)
+    { return update (key, std::strlen (key)); }
+    value_type update (const char* key, size_t len, value_type val = value_type (0)) {
+      shard_t& s = _shard[shard_of (key, len)];
+      std::lock_guard <std::mutex> lock (s.mutex);
+      return s.trie.update (key, len, val);
+    }
+    int erase (const char* key) { return erase (key, std::strlen (key)); }
+    int erase (const char* key, size_t len) {
+      shard_t& s = _shard[shard_of (key, len)];
+      std::lock_guard <std::mutex> lock (s.mutex);
+      return s.trie.erase (key, len);
+    }
+    template <typename T>
+    T exactMatchSearch (const char* key) const
+    { return exactMatchSearch <T> (key, std::strlen (key)); }
+    template <typename T>
+    T exactMatchSearch (const char* key, size_t len) const {
+      const shard_t& s = _shard[shard_of (key, len)];
+      std::lock_guard <std::mutex> lock (s.mutex);
+      return s.trie.template exactMatchSearch <T> (key, len);
+    }
+    template <typename T>
+    size_t commonPrefixSearch (const char* key, T* result, size_t result_len) const
+    { return commonPrefixSearch (key, result, result_len, std::strlen (key)); }
+    template <typename T>
+    size_t commonPrefixSearch (const char* key, T* result, size_t result_len, size_t len) const {
+      size_t num = 0;
+      for (size_t l = 1; l < PREFIX_LEN && l <= len; ++l) { // in their own shards
+        const shard_t& s = _shard[shard_of (key, l)];
+        std::lock_guard <std::mutex> lock (s.mutex);
+        npos_t from (0); size_t pos (0);
+        const index_type i = s.trie._find (key, from, pos, l);
+        if (i == CEDAR_NO_VALUE || i == CEDAR_NO_PATH) continue;
+        if (num < result_len) _set_result (&result[num], s.trie._value_of (i), l);
+        ++num;
+      }
+      if (len < PREFIX_LEN) return num;
+      const shard_t& s = _shard[shard_of (key, len)];
+      std::lock_guard <std::mutex> lock (s.mutex);
+      npos_t from = 0;
+      for (size_t pos = 0; pos < len; ) {
+        const index_type i = s.trie._find (key, from, pos, pos + 1);
+        if (i == CEDAR_NO_VALUE) continue;
+        if (i == CEDAR_NO_PATH)  break;
+        if (pos < PREFIX_LEN) continue; // found above
+        if (num < result_len) _set_result (&result[num], s.trie._value_of (i), pos);
+        ++num;
+      }
+      return num;
+    }
+    // predict key; shards are visited in turn if key is shorter than PREFIX_LEN
+    template <typename T>
+    size_t commonPrefixPredict (const char* key, T* result, size_t result_len)
+    { return commonPrefixPredict (key, result, result_len, std::strlen (key)); }
+    template <typename T>
+    size_t commonPrefixPredict (const char* key, T* result, size_t result_len, size_t len) {
+      if (len >= PREFIX_LEN)
+        return _predict (shard_of (key, len), key, result, result_len, len, 0);
+      size_t num = 0;
+      for (size_t i = 0; i < NUM_SHARDS; ++i)
+        num += _predict (i, key, result, result_len, len, num);
+      return num;
+    }
+    void suffix (char* key, size_t len, npos_t to, size_t shard_) const {
+      const shard_t& s = _shard[shard_];
+      std::lock_guard <std::mutex> lock (s.mutex);
+      s.trie.suffix (key, len, to);
+    }
+    // merge begin ()/next () of the shards; keys come in byte order if ORDERED.
+    // as with trie_t, these return the id of a value, read by value ()
+    index_type begin (cursor& c) {
+      for (size_t i = 0; i < NUM_SHARDS; ++i) {
+        shard_t& s = _shard[i];
+        std::lock_guard <std::mutex> lock (s.mutex);
+        c.from[i] = 0, c.len[i] = 0;
+        c.value[i] = s.trie.begin (c.from[i], c.len[i]);
+        _fetch (c, i);
+      }
+      return _pick (c);
+    }
+    index_type next (cursor& c) {
+      if (c.value[c.shard] == CEDAR_NO_PATH) return CEDAR_NO_PATH;
+      shard_t& s = _shard[c.shard];
+      {
+        std::lock_guard <std::mutex> lock (s.mutex);
+        c.value[c.shard] = s.trie.next (c.from[c.shard], c.len[c.shard]);
+        _fetch (c, c.shard);
+      }
+      return _pick (c);
+    }
+    value_type value (const cursor& c) const {
+      const shard_t& s = _shard[c.shard];
+      std::lock_guard <std::mutex> lock (s.mutex);
+      return s.trie.value (c.value[c.shard]);
+    }
+  private:
+    sharded_da (const sharded_da&);
+    sharded_da& operator= (const sharded_da&);
+    struct alignas (64) shard_t {
+      mutable std::mutex mutex;
+      trie_t             trie;
+    };
+    shard_t _shard[NUM_SHARDS];
+    //
+    template <typename T>
+    size_t _predict (const size_t i, const char* key, T* result, const size_t result_len,
+                     const size_t len, const size_t num_) {
+      shard_t& s = _shard[i];
+      std::lock_guard <std::mutex> lock (s.mutex);
+      npos_t from (0); size_t pos (0), p (0), num (num_);
+      if (s.trie._find (key, from, pos, len) == CEDAR_NO_PATH) return 0;
+      const npos_t root = from;
+      for (index_type id = s.trie.begin (from, p); id != CEDAR_NO_PATH; id = s.trie.next (from, p, root)) {
+        if (num < result_len) _set_result (&result[num], s.trie.value (id), p, from, i);
+        ++num;
+      }
+      return num - num_;
+    }
+    void _fetch (cursor& c, const size_t i) const {
+      if (c.value[i] == CEDAR_NO_PATH) return;
+      c.key[i].resize (c.len[i] + 1);
+      _shard[i].trie.suffix (&c.key[i][0], c.len[i], c.from[i]);
+      c.key[i].resize (c.len[i]);
+    }
+    index_type _pick (cursor& c) const { // shard with the smallest key
+      c.shard = NUM_SHARDS;
+      for (size_t i = 0; i < NUM_SHARDS; ++i)
+        if (c.value[i] != CEDAR_NO_PATH &&
+            (c.shard == NUM_SHARDS || c.key[i] < c.key[c.shard]))
+          c.shard = i;
+      if (c.shard == NUM_SHARDS) { c.shard = 0; return CEDAR_NO_PATH; }
+      return c.value[c.shard];
+    }
+    static void _set_result (result_type* x, value_type r, size_t = 0, npos_t = 0, size_t = 0)
+    { *x = r; }
+    static void _set_result (result_pair_type* x, value_type r, size_t l, npos_t = 0, size_t = 0)
+    { x->value = r; x->length = l; }
+    static void _set_result (result_triple_type* x, value_type r, size_t l, npos_t from = 0, size_t i = 0)
+    { x->value = r; x->length = l; x->id = from; x->shard = i; }
+  };
+#endif
 }
 #endif
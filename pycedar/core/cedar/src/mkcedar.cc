@@ -3,6 +3,10 @@
 // Copyright (c) 2013-2014 Naoki Yoshinaga <ynaga@tkl.iis.u-tokyo.ac.jp>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <algorithm>
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
@@ -13,15 +17,35 @@
 #endif
 
 int main (int argc, char **argv) {
+  size_t num_threads = 0; // 0: insert keys one by one
+  if (argc > 2 && std::strcmp (argv[1], "-j") == 0)
+    num_threads = static_cast <size_t> (std::strtoul (argv[2], 0, 10)), argv += 2, argc -= 2;
   if (argc < 3)
-    { std::fprintf (stderr, "Usage: %s keys trie\n", argv[0]); std::exit (1); }
+    { std::fprintf (stderr, "Usage: %s [-j N] keys trie\n", argv[0]); std::exit (1); }
   //
   cedar::da <int> trie;
   int n = 0;
   FILE* fp = argv[1][0] == '-' ? stdin : std::fopen (argv[1], "r");
   char line[8192];
-  while (std::fgets (line, 8192, fp))
-    trie.update (line, std::strlen (line) - 1, n++);
+  if (! num_threads) {
+    while (std::fgets (line, 8192, fp))
+      trie.update (line, std::strlen (line) - 1, n++);
+  } else { // sort keys and build the trie at once with N threads
+    std::vector <std::pair <std::string, int> > kv;
+    while (std::fgets (line, 8192, fp))
+      kv.push_back (std::make_pair (std::string (line, std::strlen (line) - 1), n++));
+    std::sort (kv.begin (), kv.end ());
+    std::vector <const char*> key (kv.size ());
+    std::vector <size_t>      len (kv.size ());
+    std::vector <int>         val (kv.size ());
+    for (size_t i = 0; i < kv.size (); ++i)
+      key[i] = kv[i].first.c_str (), len[i] = kv[i].first.size (), val[i] = kv[i].second;
+#ifdef USE_PREFIX_TRIE
+    trie.build (kv.size (), &key[0], &len[0], &val[0], num_threads);
+#else
+    trie.build (kv.size (), &key[0], &len[0], &val[0]);
+#endif
+  }
   std::fclose (fp);
   //
   if (trie.save (argv[2]) != 0)
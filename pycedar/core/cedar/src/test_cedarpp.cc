@@ -0,0 +1,341 @@
+// cedar -- C++ implementation of Efficiently-updatable Double ARray trie
+// checks for cedarpp.h; run by make check
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <cedarpp.h>
+
+static int failed = 0;
+#define CHECK(e) \
+  do if (! (e)) { std::fprintf (stderr, "%s:%d: failed: %s\n", __FILE__, __LINE__, #e); ++failed; } while (0)
+
+// distinct keys sharing prefixes; value i + 1 goes with key i
+static std::string key_of (size_t i) {
+  std::string k;
+  for (size_t j = i * 2654435761u % 1000003; k.size () < 3 || j; j /= 7)
+    k += static_cast <char> ('a' + j % 7);
+  char n[24];
+  std::sprintf (n, "%zu", i);
+  return k + n;
+}
+
+// readers never see a key with a value of another, while one writer adds
+// and erases keys
+static void test_concurrent () {
+  typedef cedar::da <int> trie_t;
+  cedar::concurrent_da <trie_t> t;
+  const size_t n = 5000;
+  std::vector <std::string> key (n);
+  for (size_t i = 0; i < n; ++i) key[i] = key_of (i);
+  std::atomic <bool> done (false);
+  std::atomic <int>  bad (0);
+  std::vector <std::thread> reader;
+  for (size_t r = 0; r < 2; ++r)
+    reader.push_back (std::thread ([&, r] {
+      trie_t::result_pair_type result[16];
+      while (! done.load ())
+        for (size_t i = r; i < n; i += 2) {
+          const int v = t.exactMatchSearch <int> (key[i].c_str (), key[i].size ());
+          if (v != trie_t::CEDAR_NO_VALUE && v != static_cast <int> (i + 1)) ++bad;
+          const size_t m = t.commonPrefixSearch (key[i].c_str (), result, 16, key[i].size ());
+          for (size_t j = 0; j < m && j < 16; ++j)
+            if (result[j].length == key[i].size () && result[j].value != static_cast <int> (i + 1)) ++bad;
+        }
+    }));
+  for (size_t i = 0; i < n; ++i) t.update (key[i].c_str (), key[i].size (), static_cast <int> (i + 1));
+  for (size_t i = 0; i < n; i += 3) t.erase (key[i].c_str (), key[i].size ());
+  done.store (true);
+  for (size_t r = 0; r < reader.size (); ++r) reader[r].join ();
+  CHECK (bad.load () == 0);
+  CHECK (t.num_keys () == n - (n + 2) / 3);
+  for (size_t i = 0; i < n; ++i)
+    CHECK (t.exactMatchSearch <int> (key[i].c_str (), key[i].size ()) ==
+           (i % 3 ? static_cast <int> (i + 1) : trie_t::CEDAR_NO_VALUE));
+}
+
+// values wider than int live on _tail and must stay aligned for the
+// references update () returns, through erase, compaction, freeze, save
+// and a parallel build
+template <typename T>
+static void test_wide () {
+  typedef cedar::da <T> trie_t;
+  const size_t n = 3000;
+  std::vector <std::string> key (n);
+  for (size_t i = 0; i < n; ++i) key[i] = key_of (i);
+  const T big = static_cast <T> (static_cast <long long> (1) << 62);
+  trie_t t;
+  for (size_t i = 0; i < n; ++i) {
+    T& v = t.update (key[i].c_str (), key[i].size (), static_cast <T> (i + 1));
+    CHECK (reinterpret_cast <size_t> (&v) % alignof (T) == 0);
+    v *= big; // written through the returned reference
+  }
+  for (size_t i = 0; i < n; i += 3) t.erase (key[i].c_str (), key[i].size ());
+  for (size_t i = 0; i < n; i += 6) t.update (key[i].c_str (), key[i].size (), static_cast <T> (i + 1) * big);
+  struct check {
+    static void run (const trie_t& t, const std::vector <std::string>& key, const T big) {
+      for (size_t i = 0; i < key.size (); ++i)
+        CHECK (t.template exactMatchSearch <T> (key[i].c_str (), key[i].size ()) ==
+               (i % 3 == 0 && i % 6 ? static_cast <T> (trie_t::CEDAR_NO_VALUE) : static_cast <T> (i + 1) * big));
+    }
+  };
+  check::run (t, key, big);
+  t.shrink_tail ();
+  check::run (t, key, big);
+  t.update ("wide", 4, big) += big; // grows an aligned _tail again
+  CHECK (t.template exactMatchSearch <T> ("wide", 4) == big + big);
+  t.erase ("wide", 4);
+  trie_t u;
+  t.compact (u);
+  check::run (u, key, big);
+  const char* fn = "test_cedarpp.tmp";
+  t.freeze (true, true);
+  check::run (t, key, big);
+  CHECK (t.save (fn) == 0);
+  trie_t l;
+  CHECK (l.open (fn) == 0);
+  check::run (l, key, big);
+  l.update (key[1].c_str (), key[1].size (), 0); // unshares _tail
+  check::run (l, key, big);
+  std::remove (fn);
+  std::vector <std::string> sorted (key);
+  std::sort (sorted.begin (), sorted.end ());
+  std::vector <const char*> k (n);
+  std::vector <size_t> len (n);
+  std::vector <T> val (n);
+  for (size_t i = 0; i < n; ++i)
+    k[i] = sorted[i].c_str (), len[i] = sorted[i].size (), val[i] = static_cast <T> (i + 1) * big;
+  trie_t b;
+  b.build (n, &k[0], &len[0], &val[0], 4);
+  for (size_t i = 0; i < n; ++i) {
+    T& v = b.update (k[i], len[i], 0);
+    CHECK (reinterpret_cast <size_t> (&v) % alignof (T) == 0);
+    CHECK (v == static_cast <T> (i + 1) * big);
+  }
+}
+
+// the same keys on each memory policy, through growth, erase, freeze and
+// updates that restore a frozen trie; two tries interleave their arrays
+template <typename allocator_type>
+static void test_allocator () {
+  typedef cedar::da <int, -1, -2, true, 1, 0, int, allocator_type> trie_t;
+  const size_t n = 20000;
+  std::vector <std::string> key (n);
+  for (size_t i = 0; i < n; ++i) key[i] = key_of (i);
+  trie_t t[2];
+  for (size_t i = 0; i < n; ++i) t[i % 2].update (key[i].c_str (), key[i].size (), static_cast <int> (i + 1));
+  for (size_t i = 0; i < n; i += 3) t[i % 2].erase (key[i].c_str (), key[i].size ());
+  t[0].freeze ();
+  t[1].shrink_tail ();
+  for (size_t i = 0; i < n; i += 6) t[i % 2].update (key[i].c_str (), key[i].size (), static_cast <int> (i + 1));
+  for (size_t i = 0; i < n; ++i)
+    CHECK (t[i % 2].template exactMatchSearch <int> (key[i].c_str (), key[i].size ()) ==
+           (i % 3 == 0 && i % 6 ? trie_t::CEDAR_NO_VALUE : static_cast <int> (i + 1)));
+  CHECK (t[0].num_keys () + t[1].num_keys () == n - (n + 2) / 3 + (n + 5) / 6);
+  t[1].clear ();
+  CHECK (t[1].num_keys () == 0);
+  CHECK (t[1].template exactMatchSearch <int> (key[1].c_str (), key[1].size ()) == trie_t::CEDAR_NO_VALUE);
+}
+
+// the fused layout keeps ninfo in each node, but places nodes as the split
+// one does; both give the same keys in the same order after the same
+// updates, erases, and a freeze and restore
+static void test_fused () {
+  typedef cedar::da <int> split_t;
+  typedef cedar::da <int, -1, -2, true, 1, 0, int, cedar::default_allocator, true> fused_t;
+  const size_t n = 20000;
+  std::vector <std::string> key (n);
+  for (size_t i = 0; i < n; ++i) key[i] = key_of (i);
+  split_t s;
+  fused_t f;
+  for (size_t i = 0; i < n; ++i) {
+    s.update (key[i].c_str (), key[i].size (), static_cast <int> (i + 1));
+    f.update (key[i].c_str (), key[i].size (), static_cast <int> (i + 1));
+  }
+  for (size_t i = 0; i < n; i += 3) {
+    s.erase (key[i].c_str (), key[i].size ());
+    f.erase (key[i].c_str (), key[i].size ());
+  }
+  CHECK (s.size () == f.size ());
+  f.freeze ();
+  f.update (key[3].c_str (), key[3].size (), 4);
+  s.update (key[3].c_str (), key[3].size (), 4);
+  CHECK (s.num_keys () == f.num_keys ());
+  for (size_t i = 0; i < n; ++i)
+    CHECK (f.exactMatchSearch <int> (key[i].c_str (), key[i].size ()) ==
+           s.exactMatchSearch <int> (key[i].c_str (), key[i].size ()));
+  cedar::npos_t from_s (0), from_f (0);
+  size_t len_s (0), len_f (0), m (0);
+  for (int v = s.begin (from_s, len_s), w = f.begin (from_f, len_f);
+       v != split_t::CEDAR_NO_PATH || w != fused_t::CEDAR_NO_PATH;
+       v = s.next (from_s, len_s), w = f.next (from_f, len_f), ++m) {
+    CHECK (v == w);
+    CHECK (len_s == len_f);
+    if (v != w || len_s != len_f) break;
+  }
+  CHECK (m == s.num_keys ());
+}
+
+// longestPrefixSearch () gives the last result of commonPrefixSearch (),
+// for texts that a key prefixes, that end on _tail or in a node, or that
+// no key prefixes; also on a frozen trie with a shared _tail
+static void test_longest_prefix () {
+  typedef cedar::da <int> trie_t;
+  typedef trie_t::result_pair_type result_t;
+  const size_t n = 3000;
+  std::vector <std::string> key (n);
+  for (size_t i = 0; i < n; ++i) key[i] = key_of (i);
+  trie_t t;
+  for (size_t i = 0; i < n; ++i) {
+    t.update (key[i].c_str (), key[i].size (), static_cast <int> (i + 1));
+    if (i % 5 == 0) t.update (key[i].c_str (), 3, 0); // a shorter key
+  }
+  std::vector <std::string> text;
+  for (size_t i = 0; i < n; ++i) {
+    text.push_back (key[i]);
+    text.push_back (key[i] + key[(i + 1) % n]);
+    text.push_back (key[i].substr (0, key[i].size () - 1));
+    text.push_back (key[i].substr (0, 2));
+  }
+  text.push_back ("zzz");
+  for (int frozen = 0; frozen < 2; ++frozen) {
+    if (frozen) t.freeze (true, true);
+    for (size_t i = 0; i < text.size (); ++i) {
+      result_t r[64];
+      const size_t m = t.commonPrefixSearch (text[i].c_str (), r, 64, text[i].size ());
+      const result_t l = t.longestPrefixSearch <result_t> (text[i].c_str (), text[i].size ());
+      CHECK (m < 64);
+      CHECK (l.value  == (m ? r[m - 1].value : trie_t::CEDAR_NO_VALUE));
+      CHECK (l.length == (m ? r[m - 1].length : 0));
+    }
+  }
+  const result_t l = t.longestPrefixSearch <result_t> ((key[5] + "!").c_str ());
+  CHECK (l.value == 6 && l.length == key[5].size ());
+  CHECK (t.longestPrefixSearch <int> (key[5].c_str (), 4) == 0);
+  CHECK (t.longestPrefixSearch <int> ("zzz") == trie_t::CEDAR_NO_VALUE);
+}
+
+// an erase and an insert that leave the trie of the same shape still make
+// an automaton and a top-k index stale; a rebuilt automaton finds the new key
+static void test_stale () {
+  typedef cedar::da <int> trie_t;
+  typedef cedar::aho_corasick <trie_t> matcher_t;
+  const char* key[] = { "aacb", "acaa", "bac", "bc", "cb", "cbb" };
+  trie_t t;
+  for (int i = 0; i < 6; ++i) t.update (key[i], std::strlen (key[i]), i + 1);
+  {
+    matcher_t m (t);
+    cedar::top_k <trie_t> k (t);
+    CHECK (! m.stale () && ! k.stale ());
+    t.erase ("cbb");
+    t.update ("cc", 2, 7);
+    CHECK (m.stale () && k.stale ());
+  }
+  matcher_t m (t);
+  CHECK (! m.stale ());
+  const char* text = "cbbccbbaacbcc";
+  matcher_t::match_type r[32];
+  const size_t n = m.scan (text, std::strlen (text), r, 32);
+  size_t cc = 0;
+  for (size_t i = 0; i < n && i < 32; ++i) {
+    CHECK (std::strncmp (text + r[i].start, r[i].value == 7 ? "cc" : key[r[i].value - 1], r[i].length) == 0);
+    CHECK (r[i].value != 6); // cbb
+    if (r[i].value == 7) {
+      CHECK (r[i].start == 3 || r[i].start == 11);
+      ++cc;
+    }
+  }
+  CHECK (cc == 2);
+  const size_t revision = t.revision ();
+  t.exactMatchSearch <int> ("cc");
+  CHECK (t.revision () == revision && ! m.stale ());
+  t.erase ("zz"); // no such key
+  CHECK (! m.stale ());
+  t.shrink_tail (); // moves suffixes
+  CHECK (m.stale ());
+}
+
+static size_t edit_distance (const std::string& a, const std::string& b) {
+  std::vector <size_t> row (b.size () + 1);
+  for (size_t j = 0; j <= b.size (); ++j) row[j] = j;
+  for (size_t i = 1; i <= a.size (); ++i) {
+    size_t diag = row[0];
+    row[0] = i;
+    for (size_t j = 1; j <= b.size (); ++j) {
+      const size_t d = std::min (std::min (row[j], row[j - 1]) + 1, diag + (a[i - 1] != b[j - 1]));
+      diag = row[j], row[j] = d;
+    }
+  }
+  return row[b.size ()];
+}
+
+// fuzzySearch () finds the keys a scan with edit_distance () does, with
+// the same distances and in key order, for keys edited by up to 2 bytes
+static void test_fuzzy () {
+  typedef cedar::da <int> trie_t;
+  typedef trie_t::result_triple_type result_t;
+  const size_t n = 2000;
+  std::vector <std::string> key (n);
+  for (size_t i = 0; i < n; ++i) key[i] = key_of (i).substr (0, 4 + i % 5);
+  std::sort (key.begin (), key.end ());
+  key.erase (std::unique (key.begin (), key.end ()), key.end ());
+  trie_t t;
+  for (size_t i = 0; i < key.size (); ++i) t.update (key[i].c_str (), key[i].size (), static_cast <int> (i));
+  std::vector <std::string> query;
+  for (size_t i = 0; i < key.size (); i += 37) {
+    std::string q (key[i]);
+    query.push_back (q);
+    q[1] = 'z', query.push_back (q);
+    q.erase (0, 1), query.push_back (q);
+    q.insert (2, "b"), query.push_back (q);
+  }
+  std::vector <result_t> r (key.size ());
+  std::vector <size_t>   d (key.size ());
+  for (size_t k = 0; k <= 2; ++k)
+    for (size_t i = 0; i < query.size (); ++i) {
+      const std::string& q = query[i];
+      const size_t m = t.fuzzySearch (q.c_str (), &r[0], r.size (), q.size (), k, &d[0]);
+      size_t j = 0;
+      for (size_t l = 0; l < key.size (); ++l) {
+        const size_t e = edit_distance (q, key[l]);
+        if (e > k) continue;
+        CHECK (j < m && r[j].value == static_cast <int> (l) && d[j] == e);
+        if (j < m && r[j].value != static_cast <int> (l)) break;
+        ++j;
+      }
+      CHECK (j == m);
+    }
+  t.freeze (true, true); // values past a shared _tail
+  const size_t m = t.fuzzySearch (key[0].c_str (), &r[0], r.size (), key[0].size (), 1, &d[0]);
+  CHECK (m >= 1 && r[0].value == 0 && d[0] == 0);
+}
+
+struct arena_tag {};
+
+int main () {
+  test_allocator <cedar::malloc_allocator> ();
+#ifndef _WIN32
+  test_allocator <cedar::mmap_allocator <0> > ();
+  test_allocator <cedar::mmap_allocator <1> > ();
+  test_allocator <cedar::mmap_allocator <2> > ();
+#endif
+  test_allocator <cedar::arena_allocator <arena_tag, 1 << 16> > (); // small and large regions
+  test_fused ();
+  test_longest_prefix ();
+  test_stale ();
+  test_fuzzy ();
+  test_wide <long double> ();
+#ifdef __SIZEOF_INT128__
+  test_wide <__int128> ();
+#endif
+  test_concurrent ();
+  if (failed) std::fprintf (stderr, "%d checks failed\n", failed);
+  return failed ? 1 : 0;
+}
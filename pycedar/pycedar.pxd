@@ -3,6 +3,15 @@ from libcpp cimport bool
 cdef extern from "cedarpp.h" namespace "cedar":
     ctypedef unsigned long npos_t
 
+    cdef enum syntax_type "cedar::dfa::syntax_type":
+        GLOB  "cedar::dfa::GLOB"
+        REGEX "cedar::dfa::REGEX"
+
+    cdef cppclass dfa:
+        dfa()
+        void compile (const char* pattern, size_t len, syntax_type syntax) except +
+        int num_states () const
+
     cdef cppclass da[value_type]:
 
         struct result_triple_type:
@@ -10,6 +19,19 @@ cdef extern from "cedarpp.h" namespace "cedar":
             size_t     length
             npos_t     id
 
+        struct stats_type:
+            size_t resolve
+            size_t relocated
+            size_t block_scans
+            size_t trial_exhausted
+            size_t add_block
+            size_t realloc
+            size_t realloc_bytes
+            size_t tail_append
+            size_t tail_append_bytes
+            size_t transfer[3][3]
+            size_t relocation_hist[10]
+
         da() except +
         void clear (const bool reuse)
 
@@ -24,10 +46,18 @@ cdef extern from "cedarpp.h" namespace "cedar":
 
         result_type exactMatchSearch[result_type] (const char* key, size_t len, npos_t from_) const
 
+        result_type longestPrefixSearch[result_type] (const char* key, size_t len, npos_t from_) const
+
         size_t commonPrefixPredict[result_type] (const char* key, result_type* result, size_t result_len, size_t len, npos_t from_) const
 
         size_t commonPrefixSearch[result_type] (const char* key, result_type* result, size_t result_len, size_t len, npos_t from_) const
 
+        size_t lattice (const char* key, size_t* begin, size_t* length, value_type* value, size_t result_len, size_t len) const
+
+        size_t fuzzySearch[result_type] (const char* key, result_type* result, size_t result_len, size_t len, size_t max_distance, size_t* distance)
+
+        size_t patternSearch[result_type] (const dfa& d, result_type* result, size_t result_len)
+
         void suffix (char* key, size_t len, npos_t to) const
 
         value_type traverse (const char* key, npos_t& from_, size_t& pos) const
@@ -40,9 +70,50 @@ cdef extern from "cedarpp.h" namespace "cedar":
 
         int open (const char* fn, const char* mode, const size_t offset, size_t size_)
 
+        int open_mmap (const char* fn, const size_t offset, size_t size_)
+
         void restore ()
 
+        size_t compact () except +
+
+        size_t freeze (const bool rebuild, const bool share) except +
+
+        stats_type stats () const
+
+        void reset_stats ()
+
         int begin (npos_t& from_, size_t& len)
 
         int next (npos_t& from_, size_t& len, const npos_t root)
 
+
+    cdef cppclass aho_corasick[trie_t]:
+
+        struct match_type:
+            size_t start
+            size_t length
+            int    value
+            match_type()
+
+        struct cursor:
+            int    state
+            size_t offset
+            cursor()
+
+        aho_corasick(const trie_t& t) except +
+
+        size_t num_states () const
+        size_t total_size () const
+        bool stale () const
+
+        size_t scan (const char* text, size_t len, match_type* result, size_t result_len, cursor& c) const
+
+
+    cdef cppclass top_k[trie_t]:
+
+        top_k(const trie_t& t) except +
+
+        size_t total_size () const
+        bool stale () const
+
+        size_t topKPredict[result_type] (const char* key, result_type* result, size_t k, size_t len, npos_t from_) except +
@@ -7,13 +7,19 @@ Python binding of cedar (implementation of efficiently-updatable double-array tr
 
 # system library
 import sys
+import array
+from cpython cimport array
+from cpython.bytes cimport PyBytes_FromStringAndSize
 
 # stl classes
 from libcpp.vector cimport vector
 
 # local libraries
 from pycedar cimport da
+from pycedar cimport aho_corasick
+from pycedar cimport top_k
 from pycedar cimport npos_t
+from pycedar cimport dfa, GLOB, REGEX
 
 ctypedef fused strtype:
     str
@@ -88,6 +94,44 @@ cdef unicode to_unicode(object s):
         raise TypeError("expected str, bytes or unicode, but given: %s" % type(s).__name__)
 
 
+cdef class pattern:
+    """
+    glob (* ? [a-z] [!a-z] \\x) or regex (. [a-z] [^a-z] * + ? | ( ) \\x)
+    compiled to search keys with; a pattern matches whole keys byte by byte
+    """
+    cdef dfa obj
+    cdef readonly object source
+    cdef readonly bool regex
+
+    def __cinit__(self, object source, bool regex=False):
+        cdef bytes bsource = to_bytes(source)
+        self.obj.compile(bsource, len(bsource), REGEX if regex else GLOB)
+        self.source = source
+        self.regex = regex
+
+    cpdef int num_states(self):
+        return self.obj.num_states()
+
+    def __repr__(self):
+        return 'pycedar.pattern(%r, regex=%r)' % (self.source, self.regex)
+
+# patterns compiled from strings, kept as re does
+cdef object pattern_cache = {}
+cdef size_t MAX_PATTERN_CACHE = 256
+
+cdef pattern compile_pattern(object source, bool regex):
+    cdef pattern p
+    if isinstance(source, pattern):
+        return source
+    key = (type(source), source, regex)
+    p = pattern_cache.get(key)
+    if p is None:
+        if len(pattern_cache) >= MAX_PATTERN_CACHE:
+            pattern_cache.clear()
+        p = pattern_cache[key] = pattern(source, regex)
+    return p
+
+
 cdef class base_trie:
     """
     base trie class
@@ -95,6 +139,7 @@ cdef class base_trie:
     """
     cdef da[int] obj
     cdef readonly root
+    cdef size_t revision # bumped by every update, which values may change in place
     NO_VALUE = -1
     NO_PATH  = -2
 
@@ -106,6 +151,7 @@ cdef class base_trie:
         self.clear()
 
     cpdef void clear(self, bool reuse=True):
+        self.revision += 1
         self.obj.clear(reuse)
 
     cpdef size_t capacity(self):
@@ -134,11 +180,47 @@ cdef class base_trie:
         return result, from_id, length
 
     cpdef int open(self, str filepath, str mode = 'rb', size_t offset = 0, size_t size = 0):
+        self.revision += 1
         return self.obj.open(str_to_bytes(filepath), str_to_bytes(mode), offset, size)
 
+    cpdef int open_mmap(self, str filepath, size_t offset = 0, size_t size = 0):
+        self.revision += 1
+        return self.obj.open_mmap(str_to_bytes(filepath), offset, size)
+
     cpdef int save(self, str filepath, str mode = 'wb', bool shrink = True):
         return self.obj.save(str_to_bytes(filepath), str_to_bytes(mode), shrink)
 
+    cpdef size_t compact(self):
+        self.revision += 1
+        return self.obj.compact()
+
+    cpdef size_t freeze(self, bool rebuild = True, bool share = False):
+        self.revision += 1
+        return self.obj.freeze(rebuild, share)
+
+    cpdef list pattern_search(self, object source, bool regex=False, int max_size=-1):
+        return pattern_search(self, compile_pattern(source, regex), max_size)
+
+    cpdef object stats(self):
+        cdef da[int].stats_type s = self.obj.stats()
+        cdef tuple lists = ('full', 'closed', 'open')
+        return {
+            'resolve': s.resolve,
+            'relocated': s.relocated,
+            'block_scans': s.block_scans,
+            'trial_exhausted': s.trial_exhausted,
+            'add_block': s.add_block,
+            'realloc': s.realloc,
+            'realloc_bytes': s.realloc_bytes,
+            'tail_append': s.tail_append,
+            'tail_append_bytes': s.tail_append_bytes,
+            'transfer': {(lists[i], lists[j]): s.transfer[i][j] for i in range(3) for j in range(3)},
+            'relocation_hist': [s.relocation_hist[i] for i in range(10)],
+        }
+
+    cpdef void reset_stats(self):
+        self.obj.reset_stats()
+
 ### common functions
 
 cdef list common_prefix_predict(base_trie trie, bytes key, npos_t from_id=0, int max_size=-1):
@@ -169,27 +251,87 @@ cdef list common_prefix_search(base_trie trie, bytes key, npos_t from_id=0, int
             result_list.append( (trie.suffix(r.id,r.length), r.value, r.id) )
     return result_list
 
+cdef list fuzzy_search(base_trie trie, bytes key, size_t max_distance=1, int max_size=-1):
+    cdef vector[da[int].result_triple_type] result_vector
+    cdef vector[size_t] distance_vector
+    cdef list result_list = []
+    cdef da[int].result_triple_type r
+    cdef size_t i, ret
+    if max_size < 0:
+        max_size = trie.obj.fuzzySearch[da[int].result_triple_type] (key, NULL, 0, len(key), max_distance, NULL)
+    result_vector.resize(max_size + 1)
+    distance_vector.resize(max_size + 1)
+    ret = trie.obj.fuzzySearch[da[int].result_triple_type] (key, &result_vector[0], max_size, len(key), max_distance, &distance_vector[0])
+    for i in range(min(ret, <size_t>max_size)):
+        r = result_vector[i]
+        result_list.append( (trie.suffix(r.id,r.length), r.value, r.id, distance_vector[i]) )
+    return result_list
+
+cdef list pattern_search(base_trie trie, pattern p, int max_size=-1):
+    cdef vector[da[int].result_triple_type] result_vector
+    cdef list result_list = []
+    cdef da[int].result_triple_type r
+    cdef size_t i, ret
+    if max_size < 0:
+        max_size = trie.obj.patternSearch[da[int].result_triple_type] (p.obj, NULL, 0)
+    result_vector.resize(max_size + 1)
+    ret = trie.obj.patternSearch[da[int].result_triple_type] (p.obj, &result_vector[0], max_size)
+    for i in range(min(ret, <size_t>max_size)):
+        r = result_vector[i]
+        result_list.append( (trie.suffix(r.id,r.length), r.value, r.id) )
+    return result_list
+
 cdef (int, size_t, npos_t) exact_match_search(base_trie trie, bytes key, size_t from_id=0):
     cdef da[int].result_triple_type result
     result = trie.obj.exactMatchSearch[da[int].result_triple_type](key, len(key), from_id)
     return result.value, result.length, result.id
 
+cdef (int, size_t, npos_t) longest_prefix_search(base_trie trie, bytes key, size_t from_id=0):
+    cdef da[int].result_triple_type result
+    result = trie.obj.longestPrefixSearch[da[int].result_triple_type](key, len(key), from_id)
+    return result.value, result.length, result.id
+
+# array typecode of size_t
+cdef str size_t_typecode = 'L' if sizeof(size_t) == sizeof(unsigned long) else 'Q'
+
+cdef tuple lattice(base_trie trie, bytes text):
+    cdef size_t size = len(text) + 16
+    cdef size_t ret
+    cdef array.array begin  = array.array(size_t_typecode)
+    cdef array.array length = array.array(size_t_typecode)
+    cdef array.array value  = array.array('i')
+    while True:
+        array.resize(begin, size)
+        array.resize(length, size)
+        array.resize(value, size)
+        ret = trie.obj.lattice(text, <size_t*>begin.data.as_voidptr, <size_t*>length.data.as_voidptr, value.data.as_ints, size, len(text))
+        if ret <= size:
+            break
+        size = ret
+    array.resize(begin, ret)
+    array.resize(length, ret)
+    array.resize(value, ret)
+    return begin, length, value
+
 cdef int set(base_trie trie, bytes key, int value) except *:
     cdef int* r
     if not key:
         raise KeyError("empty key is invalid")
+    trie.revision += 1
     r = <int*>&trie.obj.update(key, len(key), value)
     r[0] = value
     return r[0]
 
 cdef bytes suffix(base_trie trie, npos_t node_id, size_t length=0):
-    cdef bytes buf = b'\0' * length
+    # a new object to write in; b'\0' * 1 is the one cached by python
+    cdef bytes buf = PyBytes_FromStringAndSize(NULL, length)
     trie.obj.suffix(buf, length, node_id)
     return buf
 
 cdef int update(base_trie trie, bytes key, int delta=0) except *:
     if not key:
         raise KeyError("empty key is invalid")
+    trie.revision += 1
     return trie.obj.update(key, len(key), delta)
 
 ### specialized trie classes
@@ -206,12 +348,22 @@ cdef class bytes_trie(base_trie):
     cpdef list common_prefix_search(self, bytes key, npos_t from_id=0, int max_size=-1):
         return common_prefix_search(self, key, from_id, max_size)
 
+    cpdef list fuzzy_search(self, bytes key, size_t max_distance=1, int max_size=-1):
+        return fuzzy_search(self, key, max_distance, max_size)
+
     cpdef int erase(self, bytes key, npos_t from_id=0):
+        self.revision += 1
         return self.obj.erase(key, len(key), from_id)
 
     cpdef (int, size_t, npos_t) exact_match_search(self, bytes key, npos_t from_id=0):
         return exact_match_search(self, key, from_id)
 
+    cpdef (int, size_t, npos_t) longest_prefix_search(self, bytes key, npos_t from_id=0):
+        return longest_prefix_search(self, key, from_id)
+
+    cpdef tuple lattice(self, bytes text):
+        return lattice(self, text)
+
     cpdef int set(self, bytes key, int value) except *:
         return set(self, key, value)
 
@@ -237,8 +389,12 @@ cdef class str_trie(base_trie):
     cpdef list common_prefix_search(self, str key, npos_t from_id=0, int max_size=-1):
         return common_prefix_search(self, str_to_bytes(key), from_id, max_size)
 
+    cpdef list fuzzy_search(self, str key, size_t max_distance=1, int max_size=-1):
+        return fuzzy_search(self, str_to_bytes(key), max_distance, max_size)
+
     cpdef int erase(self, str key, npos_t from_id=0):
         cdef bytes bkey = str_to_bytes(key)
+        self.revision += 1
         return self.obj.erase(bkey, len(bkey), from_id)
 
 
@@ -246,6 +402,13 @@ cdef class str_trie(base_trie):
         cdef bytes bkey = str_to_bytes(key)
         return exact_match_search(self, bkey, from_id)
 
+    cpdef (int, size_t, npos_t) longest_prefix_search(self, str key, npos_t from_id=0):
+        cdef bytes bkey = str_to_bytes(key)
+        return longest_prefix_search(self, bkey, from_id)
+
+    cpdef tuple lattice(self, str text):
+        return lattice(self, str_to_bytes(text))
+
     cpdef int set(self, str key, int value) except *:
         return set(self, str_to_bytes(key), value)
 
@@ -272,14 +435,25 @@ cdef class unicode_trie(base_trie):
     cpdef list common_prefix_search(self, unicode key, npos_t from_id=0, int max_size=-1):
         return common_prefix_search(self, unicode_to_bytes(key), from_id, max_size)
 
+    cpdef list fuzzy_search(self, unicode key, size_t max_distance=1, int max_size=-1):
+        return fuzzy_search(self, unicode_to_bytes(key), max_distance, max_size)
+
     cpdef int erase(self, unicode key, npos_t from_id=0):
         cdef bytes bkey = unicode_to_bytes(key)
+        self.revision += 1
         return self.obj.erase(bkey, len(bkey), from_id)
 
     cpdef (int, size_t, npos_t) exact_match_search(self, unicode key, npos_t from_id=0):
         cdef bytes bkey = unicode_to_bytes(key)
         return exact_match_search(self, bkey, from_id)
 
+    cpdef (int, size_t, npos_t) longest_prefix_search(self, unicode key, npos_t from_id=0):
+        cdef bytes bkey = unicode_to_bytes(key)
+        return longest_prefix_search(self, bkey, from_id)
+
+    cpdef tuple lattice(self, unicode text):
+        return lattice(self, unicode_to_bytes(text))
+
     cpdef int set(self, unicode key, int value) except *:
         return set(self, unicode_to_bytes(key), value)
 
@@ -360,6 +534,115 @@ cdef class node:
         return repr(self.key())
 
 
+cdef class matcher:
+    """
+    find every key of a trie in a text in one pass (Aho-Corasick);
+    the trie must not be updated while the matcher is in use
+    """
+
+    cdef aho_corasick[da[int]]* obj
+    cdef aho_corasick[da[int]].cursor cursor
+    cdef vector[aho_corasick[da[int]].match_type] result_vector
+    cdef size_t revision
+    cdef readonly base_trie trie
+
+    def __cinit__(self, base_trie trie):
+        self.trie = trie
+        self.revision = trie.revision
+        self.obj = new aho_corasick[da[int]](trie.obj)
+        self.result_vector.resize(256)
+
+    def __dealloc__(self):
+        del self.obj
+
+    cpdef size_t num_states(self):
+        return self.obj.num_states()
+    cpdef size_t total_size(self):
+        return self.obj.total_size()
+    cpdef size_t offset(self):
+        return self.cursor.offset
+    cpdef bool stale(self):
+        return self.revision != self.trie.revision or self.obj.stale()
+
+    cpdef void reset(self):
+        """
+        start over from the head of a new text
+        """
+        self.cursor.state = 0
+        self.cursor.offset = 0
+
+    cpdef list feed(self, object chunk):
+        """
+        scan the next chunk of a text, keeping keys across chunks
+        :param chunk: bytes, or str encoded as utf-8
+        :return: list of (start, length, value) in bytes from the head of the text
+        """
+        cdef bytes bchunk = to_bytes(chunk)
+        cdef aho_corasick[da[int]].cursor c = self.cursor
+        cdef size_t i, ret
+        if self.stale():
+            raise RuntimeError("trie has been updated since the matcher was built")
+        ret = self.obj.scan(bchunk, len(bchunk), &self.result_vector[0], self.result_vector.size(), self.cursor)
+        if ret > self.result_vector.size():
+            self.result_vector.resize(ret)
+            self.cursor = c
+            self.obj.scan(bchunk, len(bchunk), &self.result_vector[0], ret, self.cursor)
+        return [(self.result_vector[i].start, self.result_vector[i].length, self.result_vector[i].value) for i in range(ret)]
+
+    cpdef list scan(self, object text):
+        """
+        scan a whole text
+        :param text: bytes, or str encoded as utf-8
+        :return: list of (start, length, value) in bytes, by the end of each key
+        """
+        self.reset()
+        return self.feed(text)
+
+
+cdef class ranker:
+    """
+    find keys following a prefix with the largest values, best first,
+    visiting only branches that can still place; valid until the next update
+    """
+
+    cdef top_k[da[int]]* obj
+    cdef size_t revision
+    cdef readonly base_trie trie
+
+    def __cinit__(self, base_trie trie):
+        self.trie = trie
+        self.revision = trie.revision
+        self.obj = new top_k[da[int]](trie.obj)
+
+    def __dealloc__(self):
+        del self.obj
+
+    cpdef size_t total_size(self):
+        return self.obj.total_size()
+    cpdef bool stale(self):
+        return self.revision != self.trie.revision or self.obj.stale()
+
+    cpdef list predict(self, object prefix, size_t k=10, npos_t from_id=0):
+        """
+        find the `k` keys with the largest values among those following `prefix`
+        :param prefix: bytes, or str encoded as utf-8
+        :param k: maximum number of keys
+        :return: list of (suffix, value, id) by descending value, as common_prefix_predict
+        """
+        cdef bytes bprefix = to_bytes(prefix)
+        cdef vector[da[int].result_triple_type] result_vector
+        cdef da[int].result_triple_type r
+        cdef size_t i, ret
+        if self.stale():
+            raise RuntimeError("trie has been updated since the ranker was built")
+        k = min(k, self.trie.num_keys())
+        if not k:
+            return []
+        result_vector.resize(k)
+        ret = self.obj.topKPredict[da[int].result_triple_type](bprefix, &result_vector[0], k, len(bprefix), from_id)
+        return [(self.trie.suffix(result_vector[i].id, result_vector[i].length), result_vector[i].value, result_vector[i].id) for i in range(ret)]
+
+
 cdef class dict:
     """
     python dict-like class
@@ -369,6 +652,7 @@ cdef class dict:
     cdef readonly node root
     cdef readonly object type
     cdef readonly object fallback_cast
+    cdef ranker top_ranker
 
     def __cinit__(self, type type=str):
         """
@@ -450,6 +734,73 @@ cdef class dict:
             return default
         return value
 
+    cpdef object longest_prefix(self, strtype key, object default=None):
+        """
+        find the longest key string that is a prefix of `key`
+        :param key: string to match from its head
+        :param default: value returned when no key is a prefix of `key` (default value is None)
+        :return: tuple of (key string, int value) if found, otherwise `default`
+        """
+        cdef int value
+        cdef size_t length
+        cdef npos_t node_id
+        value, length, node_id = self.trie.longest_prefix_search(key)
+        if value in (base_trie.NO_VALUE, base_trie.NO_PATH):
+            return default
+        return self.trie.suffix(node_id, length), value
+
+    cpdef list search(self, object pattern, bool regex=False):
+        """
+        find key strings matching a glob or regex pattern as a whole
+        :param pattern: glob (* ? [a-z] [!a-z]) or regex string, or pycedar.pattern object;
+                        strings are compiled once and cached
+        :param regex: take a string `pattern` as regex (. [a-z] [^a-z] * + ? | ( )) instead of glob
+        :return: list of tuple of (key string, int value)
+        """
+        return [(k, v) for k, v, i in self.trie.pattern_search(pattern, regex)]
+
+    cpdef list fuzzy(self, strtype key, size_t max_distance=1):
+        """
+        find key strings within `max_distance` edits (insertions, deletions and substitutions of bytes) of `key`
+        :param key: string to look up
+        :param max_distance: maximum edit distance
+        :return: list of tuple of (key string, int value, distance)
+        """
+        return [(k, v, d) for k, v, i, d in self.trie.fuzzy_search(key, max_distance)]
+
+    cpdef tuple lattice(self, strtype text):
+        """
+        find every key string at every position of `text` at once, e.g. to build a word lattice
+        :param text: string to search
+        :return: tuple of arrays (begin, length, value) by begin and then length, in bytes;
+                 each array supports the buffer protocol (numpy.asarray, memoryview)
+        """
+        return self.trie.lattice(text)
+
+    cpdef matcher matcher(self):
+        """
+        build a matcher to find every key in a text; see pycedar.matcher
+        :return: pycedar.matcher object, valid until the next update
+        """
+        return matcher(self.trie)
+
+    cpdef list top(self, strtype prefix, size_t k=10):
+        """
+        find the `k` key strings with the largest values among those starting with `prefix`,
+        without visiting every key; the index behind is not updated in place, but rebuilt over
+        the whole trie (O(number of nodes)) on the first call after any update (set, del,
+        update, load, compact, freeze, clear), so calls between updates are fast while
+        interleaving updates and calls costs a rebuild each time; batch updates, or build a
+        pycedar.ranker once after them
+        :param prefix: prefix string
+        :param k: maximum number of keys
+        :return: list of tuple of (key string, int value) by descending value
+        """
+        if self.top_ranker is None or self.top_ranker.stale():
+            self.top_ranker = ranker(self.trie)
+        prefix = self.fallback_cast(prefix)
+        return [(prefix + s, v) for s, v, i in self.top_ranker.predict(prefix, k)]
+
     cpdef node get_node(self, strtype key):
         """
         get node object associated with `key` string
@@ -471,12 +822,15 @@ cdef class dict:
         """
         return self.find(self.type())
 
-    cpdef int load(self, str filepath, str mode = 'rb'):
+    cpdef int load(self, str filepath, str mode = 'rb', bool mmap = False):
         """
         load trie data from `filepath`
         :param filepath: file path to load trie data
         :param mode: file open mode
+        :param mmap: map the file read-only instead of reading it (copied on the first update)
         """
+        if mmap:
+            return self.trie.open_mmap(filepath)
         return self.trie.open(filepath, mode)
 
     cpdef nodes(self):
@@ -494,6 +848,38 @@ cdef class dict:
         """
         return self.trie.save(filepath, mode, shrink)
 
+    cpdef size_t compact(self):
+        """
+        rebuild trie data densely, e.g. after many deletions
+        :return: number of bytes reclaimed
+        """
+        return self.trie.compact()
+
+    cpdef size_t freeze(self, bool rebuild=True, bool share=False):
+        """
+        drop what only updates need, for a trie to be searched only;
+        the next update restores it
+        :param rebuild: rebuild trie data densely first, as compact()
+        :param share: store common key endings once, e.g. for URLs
+        :return: number of bytes released
+        """
+        return self.trie.freeze(rebuild, share)
+
+    cpdef object stats(self):
+        """
+        counters on update paths, collected only if built with USE_STATS
+        (e.g. PYCEDAR_USE_STATS=1 python setup.py build); all zero otherwise
+        :return: python dict of counters; relocation_hist bins updates by
+                 nodes moved (0, 1, 2-3, 4-7, ...)
+        """
+        return self.trie.stats()
+
+    cpdef void reset_stats(self):
+        """
+        zero the counters returned by stats()
+        """
+        self.trie.reset_stats()
+
     cpdef int set(self, strtype key, int value) except *:
         """
         set value associating with `key` string
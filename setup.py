@@ -14,6 +14,7 @@ ext_modules=[
         'pycedar',
         ['pycedar/pycedar.pyx', 'pycedar/pycedar.pxd'],
         include_dirs = ['pycedar/core/cedar/src'],
+        define_macros = [('USE_STATS', None)] if os.environ.get('PYCEDAR_USE_STATS') else [],
         language='c++',
     ),
 ]
@@ -33,6 +33,41 @@ except Exception as e:
 print( d.get('twenty three') )
 print( d.get('twenty four') )
 print( d.get('twenty four', None) )
+print( d.longest_prefix('twenty threes') )
+print( d.longest_prefix('twenty') )
+print( d.longest_prefix('twelve') )
+assert d.longest_prefix('twenty threes') == ('twenty three', 23)
+assert d.longest_prefix('twenty t') == ('twenty', 20)
+assert d.longest_prefix('twelve') is None
+assert d.longest_prefix('twelve', -1) == -1
+print( d.matcher().scan('nineteen twenty three') )
+m = d.matcher()
+assert m.scan('nineteen twenty three') == [(0, 8, 19), (9, 6, 20), (9, 12, 23)]
+del d['nineteen']
+d['nineteeN'] = 19  # the same shape, so only the revision tells
+assert m.stale()
+try:
+    m.scan('nineteen')
+    assert False
+except RuntimeError:
+    pass
+assert d.matcher().scan('nineteeN') == [(0, 8, 19)]
+del d['nineteeN']
+d['nineteen'] = 19
+print( [list(a) for a in d.lattice('twenty one')] )
+print( d.fuzzy('twenty thre') )
+def edit_distance(a, b):
+    row = list(range(len(b) + 1))
+    for i in range(1, len(a) + 1):
+        diag, row[0] = row[0], i
+        for j in range(1, len(b) + 1):
+            diag, row[j] = row[j], min(row[j] + 1, row[j - 1] + 1, diag + (a[i - 1] != b[j - 1]))
+    return row[len(b)]
+for q in ['twenty thre', 'twenty tw', 'twenty', 'nineten', 'xyz']:
+    for k in [0, 1, 2]:
+        assert d.fuzzy(q, k) == [(w, v, edit_distance(q, w)) for w, v in d.items() if edit_distance(q, w) <= k]
+print( d.search('twenty t*') )
+print( d.top('twenty', 2) )
 
 print( list(d.find('')) )
 print( list(d.find('tw')) )
@@ -59,3 +94,29 @@ print( list(d2.items()) )
 print( d2.setdefault('eighteen', 18) )
 print( list(d2.items()) )
 
+d3 = pycedar.dict()
+d3.load('test.dat', mmap=True)
+print( list(d3.items()) )
+d3['eighteen'] = 18
+print( list(d3.items()) )
+
+del d3['eighteen']
+d3.compact()
+print( list(d3.items()) )
+d3.freeze()
+print( list(d3.items()) )
+print( d3.get('twenty') )
+d3.freeze(share=True)
+print( list(d3.items()) )
+print( d3.get('twenty three') )
+assert d3.longest_prefix('twenty twos') == ('twenty two', 22)
+assert d3.longest_prefix('nineteenth') == ('nineteen', 19)
+
+s = d3.stats()
+print( sorted(s.keys()) )
+print( len(s['relocation_hist']) )
+
+d4 = pycedar.dict()
+for k in ['[abc', 'aabc', 'babc', 'zabc']:
+    d4[k] = len(d4)
+print( d4.search('[abc') )